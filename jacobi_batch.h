@@ -0,0 +1,125 @@
+// Batched host solver for many small independent grids.
+//
+// One grid of e.g. 256 x 256 is far too small to keep a team of threads busy, so instead of
+// sweeping each grid with all threads, batch_solve() parallelises over the grids of the batch:
+// the solve proceeds in rounds of BATCH_ROUND_ITERS iterations in which the threads take the
+// grids that have not converged yet one at a time (dynamic schedule) and sweep each of them for
+// the whole round while it is in their cache. A grid stops within the round at the first norm
+// check below its tolerance; after the round the convergence mask drops the converged grids from
+// the active list. A grid is swept with the arithmetic of the single solver (jacobi_kernel plus
+// periodic top and bottom halo rows), so it ends with the same field and iteration count as
+// solving it alone.
+#ifndef JACOBI_BATCH_H
+#define JACOBI_BATCH_H
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_cpu.h"
+#include "jacobi_hugepage.h"
+#include "jacobi_pitch.h"
+
+constexpr int BATCH_ROUND_ITERS = 64;
+
+struct batch_grid {
+    // Dirichlet values of the left and right border, ny each. Empty means the boundary
+    // sin(2 pi y / (ny - 1)) of the single solver.
+    std::vector<real> left;
+    std::vector<real> right;
+    real tolerance = tol;
+
+    // Results: iterations run and last computed norm
+    int iterations = 0;
+    real l2_norm = 0.0;
+};
+
+// Solves every grid of batch (all nx x ny) from a zero initial guess for at most iter_max
+// iterations, checking the norm every nccheck iterations, with num_threads threads. If fields is
+// not null, the final field of grid g is copied to fields + g * nx * ny (dense). Returns false if
+// the grids cannot be allocated.
+static bool batch_solve(std::vector<batch_grid>& batch, const int nx, const int ny,
+                        const int iter_max, const int nccheck, const int num_threads,
+                        real* const fields, const hugepage_policy hugepages = HUGEPAGE_NONE) {
+    const int num_grids = batch.size();
+    const int pitch = row_pitch(nx, sizeof(real));
+    const size_t grid_elems = size_t(pitch) * ny;
+    // a and a_new of every grid, next to each other
+    real* const grids = (real*)hugepage_alloc(2 * grid_elems * num_grids * sizeof(real), hugepages);
+    if (nullptr == grids) return false;
+
+    std::vector<int> active(num_grids);
+    std::vector<real*> a(num_grids);
+    std::vector<real*> a_new(num_grids);
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int g = 0; g < num_grids; ++g) {
+        a[g] = grids + 2 * grid_elems * g;
+        a_new[g] = a[g] + grid_elems;
+        std::memset(a[g], 0, 2 * grid_elems * sizeof(real));
+        batch_grid& grid = batch[g];
+        if (grid.left.empty() || grid.right.empty()) {
+            initialize_boundaries(a_new[g], a[g], PI, 0, nx, pitch, ny, ny);
+        } else {
+            for (int iy = 0; iy < ny; ++iy) {
+                a[g][iy * pitch + 0] = a_new[g][iy * pitch + 0] = grid.left[iy];
+                a[g][iy * pitch + (nx - 1)] = a_new[g][iy * pitch + (nx - 1)] = grid.right[iy];
+            }
+        }
+        grid.iterations = 0;
+        grid.l2_norm = 1.0;
+    }
+
+    // The single solver starts from a norm of 1, so a grid whose tolerance is at least 1 runs no
+    // iteration and keeps its initial field
+    int num_active = 0;
+    for (int g = 0; g < num_grids; ++g)
+        if (batch[g].l2_norm > batch[g].tolerance) active[num_active++] = g;
+
+    const int iy_start = 1;
+    const int iy_end = ny - 1;
+    for (int iter = 0; num_active > 0 && iter < iter_max; iter += BATCH_ROUND_ITERS) {
+        const int round_iters = std::min(BATCH_ROUND_ITERS, iter_max - iter);
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+        for (int i = 0; i < num_active; ++i) {
+            const int g = active[i];
+            batch_grid& grid = batch[g];
+            for (int r = 0; r < round_iters; ++r) {
+                const bool calculate_norm = ((iter + r) % nccheck) == 0;
+                const real l2_norm_sq = jacobi_kernel(a_new[g], a[g], iy_start, iy_end, nx, pitch,
+                                                      1, 0, 0, nullptr, calculate_norm);
+
+                // Apply periodic boundary conditions
+                std::memcpy(a_new[g], a_new[g] + (iy_end - 1) * pitch, nx * sizeof(real));
+                std::memcpy(a_new[g] + iy_end * pitch, a_new[g] + iy_start * pitch,
+                            nx * sizeof(real));
+
+                if (calculate_norm) grid.l2_norm = std::sqrt(l2_norm_sq);
+                std::swap(a_new[g], a[g]);
+                ++grid.iterations;
+                // The single solver stops right after the iteration whose norm is converged
+                if (calculate_norm && grid.l2_norm <= grid.tolerance) break;
+            }
+        }
+
+        // Convergence mask: keep the grids that are still above their tolerance
+        int num_still_active = 0;
+        for (int i = 0; i < num_active; ++i)
+            if (batch[active[i]].l2_norm > batch[active[i]].tolerance)
+                active[num_still_active++] = active[i];
+        num_active = num_still_active;
+    }
+
+    if (fields) {
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+        for (int g = 0; g < num_grids; ++g)
+            for (int iy = 0; iy < ny; ++iy)
+                std::memcpy(fields + size_t(g) * nx * ny + iy * nx, a[g] + iy * pitch,
+                            nx * sizeof(real));
+    }
+    hugepage_free(grids);
+    return true;
+}
+
+#endif  // JACOBI_BATCH_H
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_batch.h"
+#include "jacobi_solver.h"
+
+// Batched solve of -nbatch independent small grids (jacobi_batch.h) compared with looping the
+// single solver (jacobi_solver.h) over the same grids, each of them swept with all -nthreads
+// threads. The tolerances of the grids are spread logarithmically between -tol and -tolmax, so
+// that with a large enough -niter the grids converge after different numbers of iterations. Both
+// runs use the sin boundary of the single solver, or with -dirichlet left and right borders of
+// their own for every grid, and their fields and iteration counts are compared grid by grid.
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    const int nccheck = get_argval<int>(argv, argv + argc, "-nccheck", 1);
+    const int nx = get_argval<int>(argv, argv + argc, "-nx", 256);
+    const int ny = get_argval<int>(argv, argv + argc, "-ny", 256);
+    const int num_grids = get_argval<int>(argv, argv + argc, "-nbatch", 256);
+    const int num_threads = get_argval<int>(argv, argv + argc, "-nthreads", omp_get_max_threads());
+    const double tol_min = get_argval<double>(argv, argv + argc, "-tol", tol);
+    const double tol_max = get_argval<double>(argv, argv + argc, "-tolmax", tol_min);
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+    const bool noref = get_arg(argv, argv + argc, "-noref");
+    const bool dirichlet = get_arg(argv, argv + argc, "-dirichlet");
+
+    if (num_grids < 1 || nccheck < 1 || nx < 3 || ny < 3 || tol_min <= 0.0 || tol_max < tol_min) {
+        fprintf(stderr, "ERROR: invalid -nbatch, -nccheck, -nx, -ny, -tol or -tolmax\n");
+        return -1;
+    }
+
+    omp_set_dynamic(0);
+
+    std::vector<batch_grid> batch(num_grids);
+    for (int g = 0; g < num_grids; ++g) {
+        const double t = num_grids > 1 ? double(g) / (num_grids - 1) : 0.0;
+        batch[g].tolerance = tol_min * std::pow(tol_max / tol_min, t);
+        if (dirichlet) {
+            // Grid g rises from 0 to (g + 1) / num_grids along the left border and holds
+            // -(g + 1) / num_grids on the right one
+            const real scale = real(g + 1) / num_grids;
+            batch[g].left.resize(ny);
+            batch[g].right.assign(ny, -scale);
+            for (int iy = 0; iy < ny; ++iy) batch[g].left[iy] = scale * iy / (ny - 1);
+        }
+    }
+
+    const size_t grid_elems = size_t(nx) * ny;
+    std::vector<real> fields(noref ? 0 : grid_elems * num_grids);
+    std::vector<real> field_ref(noref ? 0 : grid_elems);
+
+    if (!csv)
+        printf(
+            "Batched jacobi relaxation: %d grids of %d x %d, at most %d iterations with norm "
+            "check every %d iterations\n",
+            num_grids, ny, nx, iter_max, nccheck);
+
+    double start = omp_get_wtime();
+    if (!batch_solve(batch, nx, ny, iter_max, nccheck, num_threads,
+                     noref ? nullptr : fields.data())) {
+        fprintf(stderr, "ERROR: cannot allocate %d grids of %d x %d\n", num_grids, nx, ny);
+        return -1;
+    }
+    double stop = omp_get_wtime();
+    const double runtime_batch = stop - start;
+    long total_iters = 0;
+    for (const batch_grid& grid : batch) total_iters += grid.iterations;
+
+    // Reference: the single solver looped over the grids
+    double runtime_loop = 0.0;
+    bool result_correct = true;
+    if (!noref) {
+        solver_options options;
+        options.num_threads = num_threads;
+        options.nccheck = nccheck;
+        Solver solver(options);
+        for (int g = 0; g < num_grids && result_correct; ++g) {
+            start = omp_get_wtime();
+            solver.setup(nx, ny);
+            if (dirichlet) solver.set_boundaries(batch[g].left.data(), batch[g].right.data());
+            const int iters = solver.solve(iter_max, batch[g].tolerance);
+            runtime_loop += omp_get_wtime() - start;
+            solver.get_field(field_ref.data());
+            if (iters != batch[g].iterations) {
+                fprintf(stderr, "ERROR: grid %d took %d iterations, %d (reference)\n", g,
+                        batch[g].iterations, iters);
+                result_correct = false;
+            }
+            const real* const field = fields.data() + g * grid_elems;
+            for (int iy = 1; result_correct && iy < (ny - 1); ++iy) {
+                for (int ix = 1; result_correct && ix < (nx - 1); ++ix) {
+                    if (std::fabs(field_ref[iy * nx + ix] - field[iy * nx + ix]) > tol) {
+                        fprintf(stderr,
+                                "ERROR: grid %d: a[%d * %d + %d] = %f does not match %f "
+                                "(reference)\n",
+                                g, iy, nx, ix, field[iy * nx + ix], field_ref[iy * nx + ix]);
+                        result_correct = false;
+                    }
+                }
+            }
+        }
+    }
+
+    const double lups = double(nx - 2) * double(ny - 2) * total_iters;
+    if (result_correct) {
+        if (csv) {
+            printf("batch_cpu, %d, %d, %d, %d, %d, %d, %f, %f, %ld\n", nx, ny, iter_max, nccheck,
+                   num_grids, num_threads, runtime_batch, runtime_loop, total_iters);
+        } else {
+            printf("Num threads: %d.\n", num_threads);
+            printf("%d x %dx%d: batched: %8.4f s, %8.2f MLUPS, %ld iterations in total\n",
+                   num_grids, ny, nx, runtime_batch, lups / runtime_batch * 1.0e-6, total_iters);
+            if (!noref)
+                printf("%d x %dx%d: looped: %8.4f s, %8.2f MLUPS, speedup: %8.2f\n", num_grids, ny,
+                       nx, runtime_loop, lups / runtime_loop * 1.0e-6,
+                       runtime_loop / runtime_batch);
+        }
+    }
+    return result_correct ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+// Boundary conditions per edge of the global grid and the source term of a Poisson problem.
+//
+// Every edge is one of
+//     sin             u = sin(2 pi y), the default of the left and right edge and only valid there
+//     dirichlet[:v]   u = v
+//     neumann[:g]     du/dn = g
+//     robin:k[:g]     du/dn + k u = g
+//     periodic        the opposite edge is the periodic image, on both edges of a direction
+// with the outward normal n and v = g = 0 if omitted. The boundary nodes are the first and last
+// row and column of the grid, on the unit square with spacing hx = 1 / (nx - 1) and
+// hy = 1 / (ny - 1). Dirichlet nodes are set once; Neumann and Robin nodes are updated after
+// every sweep from the first interior node with the one sided difference
+//     (u_b - u_i) / h + k u_b = g   =>   u_b = (u_i + h g) / (1 + h k),
+// periodic columns from the opposite interior column and periodic rows by the halo exchange of
+// the solver. The interior sweep is left as it is; the default (sin left and right, periodic top
+// and bottom) needs no boundary update at all.
+//
+// With a source f the sweep solves -laplace(u) = f: jacobi_kernel adds the source field
+// b = h^2 f, prepared by bc_scale_source(), to the sum of the neighbours. The sweep weights all
+// four neighbours equally, which is the five point Laplacian only for hx = hy = h, so a source
+// needs a square grid (nx == ny).
+#ifndef JACOBI_BC_H
+#define JACOBI_BC_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "jacobi_cpu.h"
+
+enum bc_type { BC_SIN = 0, BC_DIRICHLET, BC_NEUMANN, BC_ROBIN, BC_PERIODIC };
+
+struct edge_bc {
+    bc_type type;
+    real value = 0.0;  // v of dirichlet, g of neumann and robin
+    real k = 0.0;      // Robin coefficient
+};
+
+struct boundary_conditions {
+    edge_bc left = {BC_SIN};
+    edge_bc right = {BC_SIN};
+    edge_bc top = {BC_PERIODIC};
+    edge_bc bottom = {BC_PERIODIC};
+};
+
+// Parses a number that makes up all of text. Returns false if text is empty or has anything
+// after the number.
+static bool bc_parse_number(const std::string& text, double* const value) {
+    char* end = nullptr;
+    *value = strtod(text.c_str(), &end);
+    return !text.empty() && text.c_str() + text.size() == end;
+}
+
+// Parses an edge specification (see above) into *bc, sin only if the edge is a column (left or
+// right). Returns false if it is not valid.
+static bool bc_parse_edge(const std::string& spec, const bool column, edge_bc* const bc) {
+    const size_t colon = spec.find(':');
+    const std::string name = spec.substr(0, colon);
+    double args[2] = {0.0, 0.0};
+    int num_args = 0;
+    for (size_t start = colon; std::string::npos != start; ++num_args) {
+        const size_t next = spec.find(':', start + 1);
+        if (2 == num_args ||
+            !bc_parse_number(spec.substr(start + 1, next - start - 1), &args[num_args]))
+            return false;
+        start = next;
+    }
+    if (("sin" == name && column) || "periodic" == name) {
+        if (num_args > 0) return false;
+        bc->type = "sin" == name ? BC_SIN : BC_PERIODIC;
+    } else if ("dirichlet" == name || "neumann" == name) {
+        if (num_args > 1) return false;
+        bc->type = "dirichlet" == name ? BC_DIRICHLET : BC_NEUMANN;
+        bc->value = args[0];
+    } else if ("robin" == name) {
+        if (num_args < 1) return false;
+        bc->type = BC_ROBIN;
+        bc->k = args[0];
+        bc->value = args[1];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Periodicity has to be set on both edges of a direction.
+static bool bc_valid(const boundary_conditions& bc) {
+    return (BC_PERIODIC == bc.left.type) == (BC_PERIODIC == bc.right.type) &&
+           (BC_PERIODIC == bc.top.type) == (BC_PERIODIC == bc.bottom.type);
+}
+
+static bool bc_is_default(const boundary_conditions& bc) {
+    return BC_SIN == bc.left.type && BC_SIN == bc.right.type && BC_PERIODIC == bc.top.type &&
+           BC_PERIODIC == bc.bottom.type;
+}
+
+// True if the boundary node of the edge changes during the solve
+static bool bc_is_updated(const edge_bc& bc) {
+    return BC_NEUMANN == bc.type || BC_ROBIN == bc.type || BC_PERIODIC == bc.type;
+}
+
+static real bc_edge_value(const edge_bc& bc, const real pi, const int iy, const int ny) {
+    return BC_SIN == bc.type ? real(sin(2.0 * pi * iy / (ny - 1))) : bc.value;
+}
+
+// Sets the fixed boundary nodes of rows [offset, offset + my_ny) of the global grid in a and,
+// if not null, a_new: the sin and Dirichlet columns and, if the rows include them, the Dirichlet
+// first and last row. Replaces initialize_boundaries for general boundary conditions.
+static void bc_initialize(real* __restrict__ const a_new, real* __restrict__ const a,
+                          const boundary_conditions& bc, const real pi, const int offset,
+                          const int nx, const int pitch, const int my_ny, const int ny) {
+    for (int iy = 0; iy < my_ny; ++iy) {
+        for (real* const grid : {a, a_new}) {
+            if (nullptr == grid) continue;
+            if (!bc_is_updated(bc.left))
+                grid[iy * pitch + 0] = bc_edge_value(bc.left, pi, offset + iy, ny);
+            if (!bc_is_updated(bc.right))
+                grid[iy * pitch + (nx - 1)] = bc_edge_value(bc.right, pi, offset + iy, ny);
+        }
+    }
+    for (real* const grid : {a, a_new}) {
+        if (nullptr == grid) continue;
+        if (0 == offset && BC_DIRICHLET == bc.top.type)
+            for (int ix = 1; ix < nx - 1; ++ix) grid[ix] = bc.top.value;
+        if (offset + my_ny == ny && BC_DIRICHLET == bc.bottom.type)
+            for (int ix = 1; ix < nx - 1; ++ix) grid[(my_ny - 1) * pitch + ix] = bc.bottom.value;
+    }
+}
+
+// Boundary node value from the adjacent interior node for Neumann and Robin edges
+static real bc_robin_node(const edge_bc& bc, const real interior, const real h) {
+    return (interior + h * bc.value) / (real(1.0) + h * bc.k);
+}
+
+// Updates the left and right boundary columns of rows [iy_start, iy_end) of a_new after a sweep.
+// Does nothing if both edges are fixed (sin or Dirichlet), as in the default configuration.
+static void bc_apply_columns(real* __restrict__ const a_new, const boundary_conditions& bc,
+                             const int iy_start, const int iy_end, const int nx, const int pitch) {
+    if (!bc_is_updated(bc.left) && !bc_is_updated(bc.right)) return;
+    const real hx = real(1.0) / (nx - 1);
+    for (int iy = iy_start; iy < iy_end; ++iy) {
+        real* const row = a_new + iy * pitch;
+        if (BC_PERIODIC == bc.left.type) {
+            row[0] = row[nx - 2];
+            row[nx - 1] = row[1];
+            continue;
+        }
+        if (bc_is_updated(bc.left)) row[0] = bc_robin_node(bc.left, row[1], hx);
+        if (bc_is_updated(bc.right)) row[nx - 1] = bc_robin_node(bc.right, row[nx - 2], hx);
+    }
+}
+
+// Updates the boundary row boundary_row of a Neumann or Robin top or bottom edge from the
+// adjacent interior row interior_row. Dirichlet rows are fixed and periodic rows are halo rows.
+static void bc_apply_row(real* __restrict__ const boundary_row,
+                         const real* __restrict__ const interior_row, const edge_bc& bc,
+                         const int nx, const int ny) {
+    if (BC_NEUMANN != bc.type && BC_ROBIN != bc.type) return;
+    const real hy = real(1.0) / (ny - 1);
+    for (int ix = 1; ix < nx - 1; ++ix) boundary_row[ix] = bc_robin_node(bc, interior_row[ix], hy);
+}
+
+// Scales the dense nx * ny field f in place into the source field b = h^2 f of the sweep. The
+// grid has to be square (see above).
+static void bc_scale_source(real* const f, const int nx, const int ny) {
+    const real h2 = real(1.0) / (real(nx - 1) * real(ny - 1));
+    for (size_t i = 0; i < size_t(nx) * ny; ++i) f[i] *= h2;
+}
+
+#endif  // JACOBI_BC_H
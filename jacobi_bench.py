@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+"""Benchmark driver for the Jacobi solvers.
+
+Runs a solver executable with -csv over a sweep of grid sizes, domain counts, threads per domain,
+block shapes and norm check intervals. Every case gets warmup runs followed by timed repeats and
+is summarised by median, p95, mean, standard deviation and a 95% confidence interval of the mean
+runtime, plus MLUPS (million lattice updates per second) and the model bandwidth of 8 bytes per
+update. The summary is written as CSV, one row per case in a fixed order, so results files of
+different commits can be diffed directly.
+
+Example:
+    ./jacobi_bench.py --exe ./jacobi_multi_CPU_OpenMP --sizes 1024x1024,4096x4096 \\
+        --ndomains 1,2,4 --blocks 0x0,512x8 --repeats 7 --output bench_results.csv
+"""
+
+import argparse
+import csv
+import itertools
+import math
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import time
+
+# Column of the solve runtime and of the iteration count in the -csv line of each driver. Drivers
+# that do not report iterations are assumed to run all -niter iterations.
+RUNTIME_COLUMN = {"openmp_cpu": 7, "openmp_cpu_ooc": 7, "single_threaded_copy": 7, "single_gpu": 5,
+                  "mpi_cpu": 7}
+ITERATIONS_COLUMN = {"openmp_cpu": 9, "openmp_cpu_ooc": 9, "mpi_cpu": 9}
+
+BYTES_PER_LUP = 8
+
+# Two-sided 95% Student t quantiles by degrees of freedom
+T_95 = [0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228, 2.201, 2.179,
+        2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060,
+        2.056, 2.052, 2.048, 2.045, 2.042]
+
+# The standard CPU cases, also used by jacobi_bench_compare.py
+STANDARD_CASES = {
+    "sizes": [(512, 512), (2048, 2048), (4096, 4096)],
+    "ndomains": [1, 4],
+    "nthreads": [1],
+    "blocks": [(0, 0)],
+    "nccheck": [1, 10],
+    "niter": 200,
+}
+
+FIELDS = ["driver", "nx", "ny", "ndomains", "nthreads", "blockx", "blocky", "nccheck", "niter",
+          "iterations", "repeats", "median_s", "p95_s", "mean_s", "stdev_s", "ci95_low_s",
+          "ci95_high_s", "mlups", "mlups_ci95_low", "mlups_ci95_high", "gbs"]
+
+# Case parameters that identify a row of the results file
+KEY_FIELDS = ["driver", "nx", "ny", "ndomains", "nthreads", "blockx", "blocky", "nccheck",
+              "niter"]
+
+
+def parse_list(text):
+    return [int(v) for v in text.split(",") if v]
+
+
+def parse_pairs(text):
+    pairs = []
+    for v in text.split(","):
+        x, y = v.lower().split("x")
+        pairs.append((int(x), int(y)))
+    return pairs
+
+
+def percentile(sorted_values, p):
+    """Linearly interpolated percentile of an already sorted list."""
+    if len(sorted_values) == 1:
+        return sorted_values[0]
+    pos = (len(sorted_values) - 1) * p / 100.0
+    lo = int(math.floor(pos))
+    hi = min(lo + 1, len(sorted_values) - 1)
+    return sorted_values[lo] + (sorted_values[hi] - sorted_values[lo]) * (pos - lo)
+
+
+def summarize(times):
+    times = sorted(times)
+    mean = statistics.fmean(times)
+    stdev = statistics.stdev(times) if len(times) > 1 else 0.0
+    dof = len(times) - 1
+    t = T_95[dof] if dof < len(T_95) else 1.960
+    half_width = t * stdev / math.sqrt(len(times)) if dof > 0 else 0.0
+    return {
+        "median_s": statistics.median(times),
+        "p95_s": percentile(times, 95),
+        "mean_s": mean,
+        "stdev_s": stdev,
+        "ci95_low_s": max(mean - half_width, 0.0),
+        "ci95_high_s": mean + half_width,
+    }
+
+
+def run_solver(exe, args, launcher=()):
+    """Runs the solver once and returns (driver, runtime in s, iterations or None).
+
+    launcher is prepended to the command, e.g. ["mpirun", "-np", "4"].
+    """
+    cmd = list(launcher) + [exe, "-csv"] + [str(a) for a in args]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True)
+    if proc.returncode != 0:
+        raise RuntimeError("'%s' failed with exit code %d:\n%s" %
+                           (" ".join(cmd), proc.returncode, proc.stderr.strip()))
+    for line in reversed(proc.stdout.splitlines()):
+        fields = [f.strip() for f in line.split(",")]
+        if fields[0] in RUNTIME_COLUMN:
+            driver = fields[0]
+            runtime = float(fields[RUNTIME_COLUMN[driver]])
+            iterations = None
+            if driver in ITERATIONS_COLUMN:
+                iterations = int(fields[ITERATIONS_COLUMN[driver]])
+            return driver, runtime, iterations
+    raise RuntimeError("'%s' printed no CSV result line" % " ".join(cmd))
+
+
+def run_case(exe, case, warmup, repeats, verify, extra_args, launcher=()):
+    # {ndomains} etc. in the launcher are replaced by the parameters of the case
+    launcher = [a.format(**case) for a in launcher]
+    args = ["-nx", case["nx"], "-ny", case["ny"], "-niter", case["niter"], "-nccheck",
+            case["nccheck"], "-ndomains", case["ndomains"], "-nthreads", case["nthreads"],
+            "-blockx", case["blockx"], "-blocky", case["blocky"]] + extra_args
+    # The first warmup run also checks the result against the single domain reference
+    for w in range(warmup):
+        run_solver(exe, args + ([] if verify and w == 0 else ["-noref"]), launcher)
+    times = []
+    driver = None
+    iterations = case["niter"]
+    for _ in range(repeats):
+        driver, runtime, iters = run_solver(exe, args + ["-noref"], launcher)
+        times.append(runtime)
+        if iters is not None:
+            iterations = iters
+    row = dict(case)
+    row.update(summarize(times))
+    lups = (case["nx"] - 2) * (case["ny"] - 2) * iterations
+    row["driver"] = driver
+    row["iterations"] = iterations
+    row["repeats"] = repeats
+    row["mlups"] = lups / row["median_s"] * 1.0e-6
+    row["mlups_ci95_low"] = lups / row["ci95_high_s"] * 1.0e-6
+    row["mlups_ci95_high"] = (lups / row["ci95_low_s"] * 1.0e-6 if row["ci95_low_s"] > 0
+                              else float("inf"))
+    row["gbs"] = row["mlups"] * BYTES_PER_LUP * 1.0e-3
+    return row
+
+
+def expand_cases(sizes, ndomains, nthreads, blocks, nccheck, niter):
+    cases = []
+    for (nx, ny), nd, nt, (bx, by), nc in itertools.product(sizes, ndomains, nthreads, blocks,
+                                                           nccheck):
+        cases.append({"nx": nx, "ny": ny, "ndomains": nd, "nthreads": nt, "blockx": bx,
+                      "blocky": by, "nccheck": nc, "niter": niter})
+    return cases
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return platform.processor() or "unknown"
+
+
+def git_commit():
+    try:
+        return subprocess.run(["git", "rev-parse", "--short", "HEAD"], stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL, universal_newlines=True,
+                              cwd=os.path.dirname(os.path.abspath(__file__))).stdout.strip()
+    except OSError:
+        return "unknown"
+
+
+def write_results(filename, rows, exe):
+    with open(filename, "w", newline="") as f:
+        f.write("# commit=%s exe=%s cpu=%s host=%s date=%s\n" %
+                (git_commit(), os.path.basename(exe), cpu_model(), platform.node(),
+                 time.strftime("%Y-%m-%dT%H:%M:%S")))
+        writer = csv.DictWriter(f, fieldnames=FIELDS, lineterminator="\n")
+        writer.writeheader()
+        for row in rows:
+            writer.writerow({k: ("%.6g" % row[k] if isinstance(row[k], float) else row[k])
+                             for k in FIELDS})
+
+
+def read_results(filename):
+    with open(filename, newline="") as f:
+        return list(csv.DictReader(line for line in f if not line.startswith("#")))
+
+
+def case_key(row):
+    return tuple(str(row[k]) for k in KEY_FIELDS)
+
+
+def run_sweep(exe, cases, warmup, repeats, verify, extra_args, quiet=False, launcher=()):
+    rows = []
+    for i, case in enumerate(cases):
+        row = run_case(exe, case, warmup, repeats, verify, extra_args, launcher)
+        rows.append(row)
+        if not quiet:
+            print("[%d/%d] %dx%d ndomains=%d nthreads=%d block=%dx%d nccheck=%d: "
+                  "median %.4f s, p95 %.4f s, %.1f MLUPS, %.2f GB/s" %
+                  (i + 1, len(cases), case["nx"], case["ny"], case["ndomains"],
+                   case["nthreads"], case["blockx"], case["blocky"], case["nccheck"],
+                   row["median_s"], row["p95_s"], row["mlups"], row["gbs"]), flush=True)
+    return rows
+
+
+def add_sweep_arguments(parser):
+    parser.add_argument("--exe", default="./jacobi_multi_CPU_OpenMP",
+                        help="solver executable (default: %(default)s)")
+    parser.add_argument("--warmup", type=int, default=1, help="untimed runs per case")
+    parser.add_argument("--repeats", type=int, default=5, help="timed runs per case")
+    parser.add_argument("--no-verify", action="store_true",
+                        help="skip the reference check in the first warmup run")
+    parser.add_argument("--extra", default="",
+                        help="additional solver arguments, e.g. \"-hugepages thp\"")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    add_sweep_arguments(parser)
+    parser.add_argument("--preset", choices=["standard"],
+                        help="use the standard CPU cases instead of the sweep options")
+    parser.add_argument("--sizes", default="1024x1024", help="comma separated NXxNY list")
+    parser.add_argument("--ndomains", default="1", help="comma separated domain counts")
+    parser.add_argument("--nthreads", default="1", help="comma separated threads per domain")
+    parser.add_argument("--blocks", default="0x0",
+                        help="comma separated BXxBY block shapes (0 = solver default)")
+    parser.add_argument("--nccheck", default="1", help="comma separated norm check intervals")
+    parser.add_argument("--niter", type=int, default=200, help="iterations per run")
+    parser.add_argument("--output", default="bench_results.csv", help="results CSV file")
+    args = parser.parse_args()
+
+    if args.preset == "standard":
+        cases = expand_cases(**STANDARD_CASES)
+    else:
+        cases = expand_cases(parse_pairs(args.sizes), parse_list(args.ndomains),
+                             parse_list(args.nthreads), parse_pairs(args.blocks),
+                             parse_list(args.nccheck), args.niter)
+    if args.warmup < 0 or args.repeats < 1:
+        parser.error("--warmup must be >= 0 and --repeats >= 1")
+
+    try:
+        rows = run_sweep(args.exe, cases, args.warmup, args.repeats, not args.no_verify,
+                         args.extra.split())
+    except RuntimeError as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+    write_results(args.output, rows, args.exe)
+    print("Wrote %d cases to %s" % (len(rows), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Performance regression gate for the Jacobi solvers.
+
+Runs the standard CPU cases of jacobi_bench.py (or loads a results file given with --results),
+compares the MLUPS of every case against a stored baseline results file and exits with status 1
+if any case regressed.
+
+A case regresses when its median MLUPS drops below the baseline by more than its threshold. The
+threshold is noise aware: it is the larger of --threshold and --noise-factor times the combined
+relative standard deviation of the baseline and current runtimes, so noisy cases need a larger
+drop before they fail. Regressed cases are re-run once (--confirm) and only fail if the drop is
+reproduced.
+
+Example:
+    ./jacobi_bench.py --preset standard --output bench_baseline.csv    # on the reference commit
+    ./jacobi_bench_compare.py --baseline bench_baseline.csv             # on the candidate
+"""
+
+import argparse
+import math
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+
+def relative_stdev(row):
+    mean = float(row["mean_s"])
+    return float(row["stdev_s"]) / mean if mean > 0 else 0.0
+
+
+def compare_case(base, cur, threshold, noise_factor):
+    """Returns (status, change, allowed) with change and allowed as fractions of baseline MLUPS."""
+    base_mlups = float(base["mlups"])
+    cur_mlups = float(cur["mlups"])
+    change = cur_mlups / base_mlups - 1.0
+    noise = math.sqrt(relative_stdev(base) ** 2 + relative_stdev(cur) ** 2)
+    allowed = max(threshold, noise_factor * noise)
+    if change < -allowed:
+        status = "REGRESSED"
+    elif change > allowed:
+        status = "improved"
+    else:
+        status = "ok"
+    return status, change, allowed
+
+
+def case_label(row):
+    return "%sx%s nd=%s nt=%s blk=%sx%s nccheck=%s" % (
+        row["nx"], row["ny"], row["ndomains"], row["nthreads"], row["blockx"], row["blocky"],
+        row["nccheck"])
+
+
+def case_from_row(row):
+    return {k: int(row[k]) for k in jacobi_bench.KEY_FIELDS if k != "driver"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    jacobi_bench.add_sweep_arguments(parser)
+    parser.add_argument("--baseline", default="bench_baseline.csv",
+                        help="stored baseline results file (default: %(default)s)")
+    parser.add_argument("--results",
+                        help="compare this results file instead of running the standard cases")
+    parser.add_argument("--output", help="also write the current results to this file")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="minimum relative MLUPS drop that counts as regression "
+                        "(default: %(default)s)")
+    parser.add_argument("--noise-factor", type=float, default=3.0,
+                        help="multiple of the combined relative stdev added to the threshold "
+                        "(default: %(default)s)")
+    parser.add_argument("--confirm", type=int, default=1,
+                        help="re-runs of a regressed case before it fails (default: %(default)s)")
+    args = parser.parse_args()
+
+    try:
+        baseline = {jacobi_bench.case_key(r): r for r in jacobi_bench.read_results(args.baseline)}
+    except OSError as e:
+        print("ERROR: cannot read baseline: %s" % e, file=sys.stderr)
+        return 2
+
+    extra_args = args.extra.split()
+    rerun = args.results is None
+    try:
+        if args.results:
+            current = jacobi_bench.read_results(args.results)
+        else:
+            cases = jacobi_bench.expand_cases(**jacobi_bench.STANDARD_CASES)
+            current = jacobi_bench.run_sweep(args.exe, cases, args.warmup, args.repeats,
+                                             not args.no_verify, extra_args)
+            current = [{k: str(v) for k, v in r.items()} for r in current]
+    except (OSError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 2
+    if args.output:
+        jacobi_bench.write_results(args.output, current, args.exe)
+
+    print("%-48s %10s %10s %8s %8s  %s" % ("case", "base MLUPS", "MLUPS", "change", "allowed",
+                                           "status"))
+    num_regressed = 0
+    num_missing = 0
+    for cur in current:
+        key = jacobi_bench.case_key(cur)
+        base = baseline.pop(key, None)
+        if base is None:
+            print("%-48s %10s %10.1f %8s %8s  %s" % (case_label(cur), "-", float(cur["mlups"]),
+                                                     "-", "-", "new"))
+            continue
+        status, change, allowed = compare_case(base, cur, args.threshold, args.noise_factor)
+        for _ in range(args.confirm if rerun and status == "REGRESSED" else 0):
+            try:
+                row = jacobi_bench.run_case(args.exe, case_from_row(cur), args.warmup,
+                                            args.repeats, False, extra_args)
+            except (OSError, RuntimeError) as e:
+                print("ERROR: re-run of %s: %s" % (case_label(cur), e), file=sys.stderr)
+                return 2
+            cur = {k: str(v) for k, v in row.items()}
+            status, change, allowed = compare_case(base, cur, args.threshold, args.noise_factor)
+            if status != "REGRESSED":
+                break
+        if status == "REGRESSED":
+            num_regressed += 1
+        print("%-48s %10.1f %10.1f %+7.1f%% %7.1f%%  %s" %
+              (case_label(cur), float(base["mlups"]), float(cur["mlups"]), change * 100,
+               allowed * 100, status))
+    for base in baseline.values():
+        num_missing += 1
+        print("%-48s %10.1f %10s %8s %8s  %s" % (case_label(base), float(base["mlups"]), "-",
+                                                 "-", "-", "missing"))
+
+    if num_regressed > 0:
+        print("FAILED: %d of %d cases regressed" % (num_regressed, len(current)))
+        return 1
+    print("PASSED: no MLUPS regressions in %d cases%s" %
+          (len(current), " (%d baseline cases not run)" % num_missing if num_missing else ""))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
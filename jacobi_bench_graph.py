@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Graph replay benchmark: per iteration time with and without -graph.
+
+Runs every case twice, once launching the operations of every iteration one by one (streams) and
+once replaying graphs of --graph-iters iterations captured up front (-graph), and reports the
+time per iteration of both and the launch and synchronisation overhead per iteration the replay
+saves. Both runs check the norm once every --graph-iters iterations, so they do the same work.
+Small grids, where an iteration is only a few microseconds of compute, show the overhead best;
+on large grids the two converge.
+
+The stream runs of the host driver use -taskgraph, the runtime -graph replays on; the GPU
+drivers launch their streams directly, pass --stream-args "" for them.
+
+Example:
+    ./jacobi_bench_graph.py --sizes 34x34,130x130,514x514,2050x2050 --graph-iters 10,100 \\
+        --ndomains 4 --output bench_graph.csv
+    ./jacobi_bench_graph.py --exe ./jacobi_multi_GPU_CUDA --stream-args "" --niter 10000
+"""
+
+import argparse
+import csv
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    jacobi_bench.add_sweep_arguments(parser)
+    parser.add_argument("--sizes", default="34x34,130x130,514x514,2050x2050",
+                        help="comma separated NXxNY list")
+    parser.add_argument("--graph-iters", default="10,100",
+                        help="comma separated iterations per graph")
+    parser.add_argument("--ndomains", default="4", help="comma separated domain counts")
+    parser.add_argument("--nthreads", default="1", help="comma separated threads per domain")
+    parser.add_argument("--niter", type=int, default=10000, help="iterations per run")
+    parser.add_argument("--stream-args", default="-taskgraph",
+                        help="solver arguments of the runs without graphs (default: %(default)s)")
+    parser.add_argument("--output", default="bench_graph.csv", help="results CSV file")
+    args = parser.parse_args()
+
+    graph_iters = jacobi_bench.parse_list(args.graph_iters)
+    if any(k < 1 or k >= args.niter for k in graph_iters):
+        parser.error("--graph-iters must be in [1, --niter)")
+    # The norm check interval of a case is its graph length
+    cases = jacobi_bench.expand_cases(
+        jacobi_bench.parse_pairs(args.sizes), jacobi_bench.parse_list(args.ndomains),
+        jacobi_bench.parse_list(args.nthreads), [(0, 0)], graph_iters, args.niter)
+
+    modes = ["stream", "graph"]
+    results = {mode: [] for mode in modes}
+    try:
+        for case in cases:
+            print("== %dx%d graph of %d iterations" % (case["nx"], case["ny"], case["nccheck"]),
+                  flush=True)
+            results["stream"] += jacobi_bench.run_sweep(
+                args.exe, [case], args.warmup, args.repeats, not args.no_verify,
+                args.extra.split() + args.stream_args.split())
+            results["graph"] += jacobi_bench.run_sweep(
+                args.exe, [case], args.warmup, args.repeats, not args.no_verify,
+                args.extra.split() + ["-graph", str(case["nccheck"])])
+    except (OSError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    print("\n%-28s %8s %8s %14s %14s %14s" % ("case", "domains", "graph", "stream us/it",
+                                             "graph us/it", "saved us/it"))
+    with open(args.output, "w", newline="") as f:
+        f.write("# commit=%s exe=%s cpu=%s\n" % (jacobi_bench.git_commit(),
+                                                 os.path.basename(args.exe),
+                                                 jacobi_bench.cpu_model()))
+        fields = ["mode", "graph_iters", "us_per_iter"] + jacobi_bench.FIELDS + ["saved_us"]
+        writer = csv.DictWriter(f, fieldnames=fields, lineterminator="\n")
+        writer.writeheader()
+        for i, case in enumerate(cases):
+            per_iter = {mode: results[mode][i]["median_s"] / results[mode][i]["iterations"] *
+                        1.0e6 for mode in modes}
+            saved = per_iter["stream"] - per_iter["graph"]
+            print("%-28s %8d %8d %14.2f %14.2f %14.2f" %
+                  ("%dx%d" % (case["nx"], case["ny"]), case["ndomains"], case["nccheck"],
+                   per_iter["stream"], per_iter["graph"], saved))
+            for mode in modes:
+                row = results[mode][i]
+                out = {k: ("%.6g" % row[k] if isinstance(row[k], float) else row[k])
+                       for k in jacobi_bench.FIELDS}
+                out.update({"mode": mode, "graph_iters": case["nccheck"],
+                            "us_per_iter": "%.4f" % per_iter[mode], "saved_us": "%.4f" % saved})
+                writer.writerow(out)
+    print("Wrote %d cases x %d modes to %s" % (len(cases), len(modes), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
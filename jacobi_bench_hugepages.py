@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Huge page benchmark for the host Jacobi solver.
+
+Runs the same sweep as jacobi_bench.py once per -hugepages policy and reports the MLUPS of every
+case and policy together with the speedup over regular pages. The page policy the solver
+actually used is probed first, so a requested 2m or 1g run that fell back to transparent huge
+pages (empty hugetlbfs pool) is labelled as such.
+
+Example:
+    ./jacobi_bench_hugepages.py --sizes 4096x4096,7168x7168 --ndomains 1,4 \\
+        --policies none,thp,2m --output bench_hugepages.csv
+"""
+
+import argparse
+import csv
+import re
+import subprocess
+import sys
+import os
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+POLICIES = ["none", "thp", "2m", "1g"]
+
+
+def probe_policy(exe, policy):
+    """Returns the policy the solver falls back to when asked for policy."""
+    proc = subprocess.run([exe, "-nx", "64", "-ny", "64", "-niter", "1", "-ndomains", "1",
+                           "-noref", "-hugepages", policy], stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, universal_newlines=True)
+    if proc.returncode != 0:
+        raise RuntimeError("'%s -hugepages %s' failed:\n%s" % (exe, policy, proc.stderr.strip()))
+    match = re.search(r"Huge pages: requested \S+, using (\S+),", proc.stdout)
+    return match.group(1) if match else policy
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    jacobi_bench.add_sweep_arguments(parser)
+    parser.add_argument("--policies", default="none,thp",
+                        help="comma separated -hugepages policies, the first one is the "
+                        "reference (default: %(default)s)")
+    parser.add_argument("--sizes", default="4096x4096", help="comma separated NXxNY list")
+    parser.add_argument("--ndomains", default="1", help="comma separated domain counts")
+    parser.add_argument("--nthreads", default="1", help="comma separated threads per domain")
+    parser.add_argument("--blocks", default="0x0",
+                        help="comma separated BXxBY block shapes (0 = solver default)")
+    parser.add_argument("--nccheck", default="1", help="comma separated norm check intervals")
+    parser.add_argument("--niter", type=int, default=200, help="iterations per run")
+    parser.add_argument("--output", default="bench_hugepages.csv", help="results CSV file")
+    args = parser.parse_args()
+
+    policies = [p for p in args.policies.split(",") if p]
+    unknown = [p for p in policies if p not in POLICIES]
+    if unknown or not policies:
+        parser.error("--policies must be a list of %s" % ", ".join(POLICIES))
+    cases = jacobi_bench.expand_cases(
+        jacobi_bench.parse_pairs(args.sizes), jacobi_bench.parse_list(args.ndomains),
+        jacobi_bench.parse_list(args.nthreads), jacobi_bench.parse_pairs(args.blocks),
+        jacobi_bench.parse_list(args.nccheck), args.niter)
+
+    results = {}
+    used = {}
+    try:
+        for policy in policies:
+            used[policy] = probe_policy(args.exe, policy)
+            print("== -hugepages %s (using %s)" % (policy, used[policy]), flush=True)
+            rows = jacobi_bench.run_sweep(args.exe, cases, args.warmup, args.repeats,
+                                          not args.no_verify,
+                                          args.extra.split() + ["-hugepages", policy])
+            results[policy] = rows
+    except (OSError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    reference = policies[0]
+    print("\n%-40s %-10s %10s %10s %8s" % ("case", "hugepages", "MLUPS", "CI95 low", "speedup"))
+    with open(args.output, "w", newline="") as f:
+        f.write("# commit=%s exe=%s cpu=%s\n" % (jacobi_bench.git_commit(),
+                                                 os.path.basename(args.exe),
+                                                 jacobi_bench.cpu_model()))
+        fields = ["hugepages", "hugepages_used"] + jacobi_bench.FIELDS + ["speedup"]
+        writer = csv.DictWriter(f, fieldnames=fields, lineterminator="\n")
+        writer.writeheader()
+        for i, case in enumerate(cases):
+            label = "%dx%d nd=%d nt=%d blk=%dx%d nccheck=%d" % (
+                case["nx"], case["ny"], case["ndomains"], case["nthreads"], case["blockx"],
+                case["blocky"], case["nccheck"])
+            for policy in policies:
+                row = results[policy][i]
+                speedup = row["mlups"] / results[reference][i]["mlups"]
+                print("%-40s %-10s %10.1f %10.1f %8.3f" %
+                      (label, policy if used[policy] == policy else
+                       "%s->%s" % (policy, used[policy]), row["mlups"], row["mlups_ci95_low"],
+                       speedup))
+                out = {k: ("%.6g" % row[k] if isinstance(row[k], float) else row[k])
+                       for k in jacobi_bench.FIELDS}
+                out.update({"hugepages": policy, "hugepages_used": used[policy],
+                            "speedup": "%.4f" % speedup})
+                writer.writerow(out)
+    print("Wrote %d cases x %d policies to %s" % (len(cases), len(policies), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Strong and weak scaling benchmark of the MPI driver.
+
+Strong scaling solves the same --size grid on every rank count of --ranks. Weak scaling keeps
+the rows per rank of --size fixed, so the global grid grows with the ranks: --size is the grid of
+one rank and r ranks solve NX x ((NY - 2) * r + 2). Every run is launched with --launcher, in
+which {ndomains} is replaced by the rank count, and summarised like jacobi_bench.py. The report
+adds the speedup and the parallel efficiency relative to the smallest rank count r0, both from
+the update rate, so that runs stopping at different iterations compare fairly:
+    speedup = MLUPS(r) / MLUPS(r0),   efficiency = speedup * r0 / r
+which is T(r0) r0 / (T(r) r) for strong scaling and T(r0) / T(r) for weak scaling.
+
+On one box the ranks share the memory bandwidth of the node, so both curves flatten once the
+bandwidth is saturated; across nodes pass the host list of the MPI installation in --launcher.
+With --launcher "" and --exe ./jacobi_multi_CPU_OpenMP the same sweep runs the host driver with
+-ndomains as the rank count, as a shared memory baseline.
+
+Example:
+    ./jacobi_bench_scaling.py --size 4096x4096 --ranks 1,2,4,8 --mode strong,weak \\
+        --launcher "mpirun --oversubscribe -np {ndomains}" --output bench_scaling.csv
+"""
+
+import argparse
+import csv
+import os
+import shlex
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    jacobi_bench.add_sweep_arguments(parser)
+    parser.set_defaults(exe="./jacobi_multi_CPU_MPI")
+    parser.add_argument("--size", default="2050x2050",
+                        help="NXxNY of the strong scaling grid and of one rank for weak scaling")
+    parser.add_argument("--ranks", default="1,2,4", help="comma separated rank counts")
+    parser.add_argument("--mode", default="strong,weak",
+                        help="comma separated scaling modes, strong and/or weak")
+    parser.add_argument("--nthreads", type=int, default=1, help="threads per rank")
+    parser.add_argument("--nccheck", type=int, default=10, help="norm check interval")
+    parser.add_argument("--niter", type=int, default=1000, help="iterations per run")
+    parser.add_argument("--launcher", default="mpirun -np {ndomains}",
+                        help="command prefix of every run (default: %(default)s)")
+    parser.add_argument("--output", default="bench_scaling.csv", help="results CSV file")
+    args = parser.parse_args()
+
+    modes = [m for m in args.mode.split(",") if m]
+    if not modes or any(m not in ("strong", "weak") for m in modes):
+        parser.error("--mode must be a list of strong and weak")
+    ranks = sorted(jacobi_bench.parse_list(args.ranks))
+    if not ranks or ranks[0] < 1:
+        parser.error("--ranks must be a list of positive rank counts")
+    (nx, ny), = jacobi_bench.parse_pairs(args.size)
+    launcher = shlex.split(args.launcher)
+
+    results = []
+    try:
+        for mode in modes:
+            for r in ranks:
+                case_ny = ny if mode == "strong" else (ny - 2) * r + 2
+                case = jacobi_bench.expand_cases([(nx, case_ny)], [r], [args.nthreads],
+                                                 [(0, 0)], [args.nccheck], args.niter)[0]
+                print("== %s scaling, %d ranks, %dx%d" % (mode, r, nx, case_ny), flush=True)
+                row = jacobi_bench.run_sweep(args.exe, [case], args.warmup, args.repeats,
+                                             not args.no_verify, args.extra.split(),
+                                             launcher=launcher)[0]
+                row["mode"] = mode
+                results.append(row)
+    except (OSError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    print("\n%-8s %6s %14s %10s %10s %10s %12s" % ("mode", "ranks", "grid", "median s", "MLUPS",
+                                                   "speedup", "efficiency"))
+    with open(args.output, "w", newline="") as f:
+        f.write("# commit=%s exe=%s cpu=%s launcher=%s\n" %
+                (jacobi_bench.git_commit(), os.path.basename(args.exe),
+                 jacobi_bench.cpu_model(), args.launcher))
+        fields = ["mode", "speedup", "efficiency"] + jacobi_bench.FIELDS
+        writer = csv.DictWriter(f, fieldnames=fields, lineterminator="\n")
+        writer.writeheader()
+        for mode in modes:
+            rows = [row for row in results if row["mode"] == mode]
+            base = rows[0]
+            for row in rows:
+                speedup = row["mlups"] / base["mlups"]
+                efficiency = speedup * base["ndomains"] / row["ndomains"]
+                print("%-8s %6d %14s %10.4f %10.1f %10.2f %11.1f%%" %
+                      (mode, row["ndomains"], "%dx%d" % (row["nx"], row["ny"]), row["median_s"],
+                       row["mlups"], speedup, efficiency * 100.0))
+                out = {k: ("%.6g" % row[k] if isinstance(row[k], float) else row[k])
+                       for k in jacobi_bench.FIELDS}
+                out.update({"mode": mode, "speedup": "%.4f" % speedup,
+                            "efficiency": "%.4f" % efficiency})
+                writer.writerow(out)
+    print("Wrote %d runs to %s" % (len(results), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
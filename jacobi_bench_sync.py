@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Synchronisation scaling benchmark for the host Jacobi solver.
+
+Runs the same sweep once per synchronisation mode of the domain loop and reports the MLUPS of
+every thread count together with the speedup over the barrier loop:
+
+    barrier     the main solve, an OpenMP barrier after every iteration
+    p2p         -p2p, sequence counters between neighbouring domains only
+    taskgraph   -taskgraph, stream and event dependencies on a work stealing pool
+
+The thread counts are domain counts with --nthreads threads each, by default one thread per
+domain up to 128, so the cost of a global barrier per iteration shows up against the point to
+point waits. Use a grid small enough for the per iteration synchronisation to matter and an
+--nccheck larger than one, since an iteration that checks the norm waits for all domains in every
+mode.
+
+Example:
+    ./jacobi_bench_sync.py --sizes 2048x2048 --threads 1,2,4,8,16,32,64,128 --nccheck 100 \\
+        --output bench_sync.csv
+"""
+
+import argparse
+import csv
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+MODES = {"barrier": [], "p2p": ["-p2p"], "taskgraph": ["-taskgraph"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    jacobi_bench.add_sweep_arguments(parser)
+    parser.add_argument("--modes", default="barrier,p2p,taskgraph",
+                        help="comma separated modes, the first one is the reference "
+                        "(default: %(default)s)")
+    parser.add_argument("--sizes", default="2048x2048", help="comma separated NXxNY list")
+    parser.add_argument("--threads", default="1,2,4,8,16,32,64,128",
+                        help="comma separated total thread counts")
+    parser.add_argument("--nthreads", type=int, default=1, help="threads per domain")
+    parser.add_argument("--nccheck", default="100", help="comma separated norm check intervals")
+    parser.add_argument("--niter", type=int, default=1000, help="iterations per run")
+    parser.add_argument("--output", default="bench_sync.csv", help="results CSV file")
+    args = parser.parse_args()
+
+    modes = [m for m in args.modes.split(",") if m]
+    unknown = [m for m in modes if m not in MODES]
+    if unknown or not modes:
+        parser.error("--modes must be a list of %s" % ", ".join(MODES))
+    threads = jacobi_bench.parse_list(args.threads)
+    if any(t % args.nthreads for t in threads):
+        parser.error("--threads must be multiples of --nthreads")
+    cases = jacobi_bench.expand_cases(
+        jacobi_bench.parse_pairs(args.sizes), [t // args.nthreads for t in threads],
+        [args.nthreads], [(0, 0)], jacobi_bench.parse_list(args.nccheck), args.niter)
+
+    results = {}
+    try:
+        for mode in modes:
+            print("== %s" % mode, flush=True)
+            results[mode] = jacobi_bench.run_sweep(args.exe, cases, args.warmup, args.repeats,
+                                                   not args.no_verify,
+                                                   args.extra.split() + MODES[mode])
+    except (OSError, RuntimeError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    reference = modes[0]
+    print("\n%-28s %8s %-10s %10s %10s %8s" % ("case", "threads", "mode", "MLUPS", "CI95 low",
+                                              "speedup"))
+    with open(args.output, "w", newline="") as f:
+        f.write("# commit=%s exe=%s cpu=%s\n" % (jacobi_bench.git_commit(),
+                                                 os.path.basename(args.exe),
+                                                 jacobi_bench.cpu_model()))
+        fields = ["mode", "threads"] + jacobi_bench.FIELDS + ["speedup"]
+        writer = csv.DictWriter(f, fieldnames=fields, lineterminator="\n")
+        writer.writeheader()
+        for i, case in enumerate(cases):
+            label = "%dx%d nccheck=%d" % (case["nx"], case["ny"], case["nccheck"])
+            num_threads = case["ndomains"] * case["nthreads"]
+            for mode in modes:
+                row = results[mode][i]
+                speedup = row["mlups"] / results[reference][i]["mlups"]
+                print("%-28s %8d %-10s %10.1f %10.1f %8.3f" %
+                      (label, num_threads, mode, row["mlups"], row["mlups_ci95_low"], speedup))
+                out = {k: ("%.6g" % row[k] if isinstance(row[k], float) else row[k])
+                       for k in jacobi_bench.FIELDS}
+                out.update({"mode": mode, "threads": num_threads, "speedup": "%.4f" % speedup})
+                writer.writerow(out)
+    print("Wrote %d cases x %d modes to %s" % (len(cases), len(modes), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
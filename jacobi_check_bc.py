@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Boundary condition check of the host driver's execution modes.
+
+Runs a small grid with every --bc condition on the top and bottom edges, in every --modes
+execution mode and on every --ndomains domain count, --repeats times each, and exits with status
+1 if any run fails. Every run verifies against the driver's single domain reference, so a run
+fails when the domains of a mode get the halos or the boundary rows in the wrong order. The
+ordering bugs this catches are races, so a clean pass needs several repeats and more workers
+than cores (--nthreads). The -graph modes replay both an even and an odd number of iterations.
+
+Example:
+    ./jacobi_check_bc.py --repeats 10
+    ./jacobi_check_bc.py --modes=-taskgraph --ndomains 2 --bc neumann/neumann --repeats 50
+"""
+
+import argparse
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import jacobi_bench  # noqa: E402
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--exe", default="./jacobi_multi_CPU_OpenMP",
+                        help="solver executable (default: %(default)s)")
+    parser.add_argument("--size", default="67x53", help="NXxNY of the grid")
+    parser.add_argument("--niter", type=int, default=200, help="iterations per run")
+    parser.add_argument("--ndomains", default="1,2,5", help="comma separated domain counts")
+    parser.add_argument("--nthreads", type=int, default=2, help="threads per domain")
+    parser.add_argument("--modes", default=",-p2p,-taskgraph,-graph 3,-graph 4",
+                        help="comma separated solver arguments of the execution modes, an empty "
+                             "entry is the barrier solve (default: %(default)s)")
+    parser.add_argument("--bc", default="periodic/periodic,dirichlet:1/neumann,neumann/neumann,"
+                                        "robin:1:0.5/neumann",
+                        help="comma separated TOP/BOTTOM conditions (default: %(default)s)")
+    parser.add_argument("--repeats", type=int, default=5, help="runs per case")
+    parser.add_argument("--extra", default="", help="extra solver arguments")
+    args = parser.parse_args()
+
+    (nx, ny), = jacobi_bench.parse_pairs(args.size)
+    conditions = [bc.split("/") for bc in args.bc.split(",")]
+    if any(len(bc) != 2 for bc in conditions):
+        parser.error("--bc must list TOP/BOTTOM pairs")
+
+    failed = 0
+    runs = 0
+    for top, bottom in conditions:
+        for mode in args.modes.split(","):
+            for ndomains in jacobi_bench.parse_list(args.ndomains):
+                label = "%-22s %-12s nd=%d" % (top + "/" + bottom, mode or "barrier", ndomains)
+                solver_args = (["-nx", nx, "-ny", ny, "-niter", args.niter, "-ndomains",
+                                ndomains, "-nthreads", args.nthreads, "-bctop", top,
+                                "-bcbottom", bottom] + mode.split() + args.extra.split())
+                errors = 0
+                for _ in range(args.repeats):
+                    runs += 1
+                    try:
+                        jacobi_bench.run_solver(args.exe, solver_args)
+                    except (OSError, RuntimeError) as e:
+                        if not errors:
+                            print("ERROR: %s" % e, file=sys.stderr)
+                        errors += 1
+                print("%s  %s" % (label, "%d of %d runs FAILED" % (errors, args.repeats)
+                                  if errors else "ok"), flush=True)
+                failed += errors
+
+    print("%d of %d runs failed" % (failed, runs))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
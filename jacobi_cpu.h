@@ -0,0 +1,191 @@
+// Host kernels shared by the host driver and the embeddable solver (jacobi_solver.h).
+//
+// The grids are stored with the row pitch of jacobi_pitch.h; a domain owns rows
+// [iy_start, iy_end) with one halo row above and below.
+#ifndef JACOBI_CPU_H
+#define JACOBI_CPU_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_numa.h"
+#include "jacobi_perf.h"
+
+typedef float real;
+constexpr real tol = 1.0e-8;
+
+const real PI = 2.0 * std::asin(1.0);
+
+static inline void initialize_boundaries(real* __restrict__ const a_new, real* __restrict__ const a,
+                                         const real pi, const int offset, const int nx,
+                                         const int pitch, const int my_ny, const int ny) {
+    for (int iy = 0; iy < my_ny; ++iy) {
+        const real y0 = sin(2.0 * pi * (offset + iy) / (ny - 1));
+        a[iy * pitch + 0] = y0;
+        a[iy * pitch + (nx - 1)] = y0;
+        if (a_new) {
+            a_new[iy * pitch + 0] = y0;
+            a_new[iy * pitch + (nx - 1)] = y0;
+        }
+    }
+}
+
+// Updates columns [ix_start, ix_end) of row iy and returns the squared L2 norm of the update.
+template <bool has_source>
+static inline real jacobi_row(real* __restrict__ const a_new, const real* __restrict__ const a,
+                              const real* __restrict__ const source, const int iy,
+                              const int ix_start, const int ix_end, const int pitch) {
+    real row_l2_norm = 0.0;
+#pragma omp simd reduction(+ : row_l2_norm)
+    for (int ix = ix_start; ix < ix_end; ++ix) {
+        real sum = a[iy * pitch + ix + 1] + a[iy * pitch + ix - 1] + a[(iy + 1) * pitch + ix] +
+                   a[(iy - 1) * pitch + ix];
+        if (has_source) sum += source[iy * pitch + ix];
+        const real new_val = real(0.25) * sum;
+        a_new[iy * pitch + ix] = new_val;
+        const real residue = new_val - a[iy * pitch + ix];
+        row_l2_norm += residue * residue;
+    }
+    return row_l2_norm;
+}
+
+// Returns the squared L2 norm of the update of rows [iy_start, iy_end) of a grid whose rows are
+// pitch elements apart (see jacobi_pitch.h). The rows are swept in blocks of block_y rows by
+// block_x columns, the host analogue of the CUDA thread block shape, which are distributed
+// statically over the num_threads threads of the domain. block_x = 0 means full rows and
+// block_y = 0 one block of rows per thread. If team_affinity is not null, team thread t runs on
+// the CPUs of team_affinity[t]. If source is not null, the source field (same layout as a, see
+// jacobi_bc.h) is added to the neighbour sum; the row sweep is specialised for both cases so the
+// inner loop stays the same without a source.
+static inline real jacobi_kernel(real* __restrict__ const a_new, const real* __restrict__ const a,
+                                 const int iy_start, const int iy_end, const int nx,
+                                 const int pitch, const int num_threads, int block_x, int block_y,
+                                 const cpu_set_t* const team_affinity, const bool calculate_norm,
+                                 const real* __restrict__ const source = nullptr) {
+    if (block_x <= 0) block_x = nx - 2;
+    if (block_y <= 0) block_y = (iy_end - iy_start + num_threads - 1) / num_threads;
+    const int num_blocks_x = (nx - 2 + block_x - 1) / block_x;
+    const int num_blocks_y = (iy_end - iy_start + block_y - 1) / block_y;
+    real l2_norm = 0.0;
+#pragma omp parallel num_threads(num_threads) reduction(+ : l2_norm)
+    {
+        if (team_affinity) numa_bind_thread(&team_affinity[omp_get_thread_num()]);
+        const perf_values p0 = perf_begin();
+#pragma omp for collapse(2) schedule(static) nowait
+        for (int by = 0; by < num_blocks_y; ++by) {
+            for (int bx = 0; bx < num_blocks_x; ++bx) {
+                const int iy_block_end = std::min(iy_start + (by + 1) * block_y, iy_end);
+                const int ix_block_start = 1 + bx * block_x;
+                const int ix_block_end = std::min(ix_block_start + block_x, nx - 1);
+                for (int iy = iy_start + by * block_y; iy < iy_block_end; ++iy) {
+                    const real row_l2_norm =
+                        source ? jacobi_row<true>(a_new, a, source, iy, ix_block_start,
+                                                  ix_block_end, pitch)
+                               : jacobi_row<false>(a_new, a, source, iy, ix_block_start,
+                                                   ix_block_end, pitch);
+                    if (calculate_norm) l2_norm += row_l2_norm;
+                }
+            }
+        }
+        perf_end(PERF_PHASE_STENCIL, p0);
+    }
+    return l2_norm;
+}
+
+// In place variant of jacobi_kernel used by -inplace: rows [iy_start, iy_end) of a are overwritten
+// with their update, reading the row above iy_start from halo_top and the row below iy_end - 1
+// from halo_bottom. Every thread sweeps one band of full rows top down and keeps the old values of
+// the row it updates and of the row above in a rolling window of two row buffers. The old rows
+// bordering a band, which the neighbouring threads overwrite, are saved before anyone writes. The
+// arithmetic is that of jacobi_kernel, so the result is identical to the two buffer sweep.
+static inline real jacobi_kernel_inplace(real* __restrict__ const a, const real* const halo_top,
+                                         const real* const halo_bottom, const int iy_start,
+                                         const int iy_end, const int nx, const int pitch,
+                                         const int num_threads,
+                                         const cpu_set_t* const team_affinity,
+                                         const bool calculate_norm) {
+    const int band = (iy_end - iy_start + num_threads - 1) / num_threads;
+    real l2_norm = 0.0;
+#pragma omp parallel num_threads(num_threads) reduction(+ : l2_norm)
+    {
+        if (team_affinity) numa_bind_thread(&team_affinity[omp_get_thread_num()]);
+        const perf_values p0 = perf_begin();
+        static thread_local std::vector<real> rows;
+        rows.resize(4 * pitch);
+        real* const above_copy = rows.data();
+        real* const below_copy = above_copy + pitch;
+        real* const window[2] = {above_copy + 2 * pitch, above_copy + 3 * pitch};
+
+        const int y0 = std::min(iy_start + omp_get_thread_num() * band, iy_end);
+        const int y1 = std::min(y0 + band, iy_end);
+        const real* above = halo_top;
+        const real* below = halo_bottom;
+        if (y0 > iy_start && y0 < y1) {
+            std::memcpy(above_copy, a + (y0 - 1) * pitch, nx * sizeof(real));
+            above = above_copy;
+        }
+        if (y1 < iy_end && y0 < y1) {
+            std::memcpy(below_copy, a + y1 * pitch, nx * sizeof(real));
+            below = below_copy;
+        }
+#pragma omp barrier
+        for (int iy = y0; iy < y1; ++iy) {
+            real* const old_row = window[(iy - y0) % 2];
+            real* const row = a + iy * pitch;
+            const real* const next = iy + 1 < y1 ? a + (iy + 1) * pitch : below;
+            std::memcpy(old_row, row, nx * sizeof(real));
+            real row_l2_norm = 0.0;
+#pragma omp simd reduction(+ : row_l2_norm)
+            for (int ix = 1; ix < nx - 1; ++ix) {
+                const real new_val =
+                    real(0.25) * (old_row[ix + 1] + old_row[ix - 1] + next[ix] + above[ix]);
+                row[ix] = new_val;
+                const real residue = new_val - old_row[ix];
+                row_l2_norm += residue * residue;
+            }
+            if (calculate_norm) l2_norm += row_l2_norm;
+            above = old_row;
+        }
+        perf_end(PERF_PHASE_STENCIL, p0);
+    }
+    return l2_norm;
+}
+
+// Zeroes a domain buffer with the same block distribution as jacobi_kernel so that, under the
+// first touch policy of Linux, every page of rows [iy_start, iy_end) is placed on the NUMA node
+// of the thread that updates it. The halo rows are touched by the calling domain thread, which
+// copies them.
+static inline void first_touch(real* __restrict__ const a, const int iy_start, const int iy_end,
+                               const int nx, const int pitch, const int num_threads, int block_x,
+                               int block_y, const cpu_set_t* const team_affinity) {
+    if (block_x <= 0) block_x = nx - 2;
+    if (block_y <= 0) block_y = (iy_end - iy_start + num_threads - 1) / num_threads;
+    const int num_blocks_x = (nx - 2 + block_x - 1) / block_x;
+    const int num_blocks_y = (iy_end - iy_start + block_y - 1) / block_y;
+    if (team_affinity) numa_bind_thread(&team_affinity[0]);
+    std::memset(a + (iy_start - 1) * pitch, 0, pitch * sizeof(real));
+    std::memset(a + iy_end * pitch, 0, pitch * sizeof(real));
+#pragma omp parallel num_threads(num_threads)
+    {
+        if (team_affinity) numa_bind_thread(&team_affinity[omp_get_thread_num()]);
+#pragma omp for collapse(2) schedule(static) nowait
+        for (int by = 0; by < num_blocks_y; ++by) {
+            for (int bx = 0; bx < num_blocks_x; ++bx) {
+                const int iy_block_end = std::min(iy_start + (by + 1) * block_y, iy_end);
+                // The first and last block of a row also own the boundary and padding columns
+                const int ix_block_start = 0 == bx ? 0 : 1 + bx * block_x;
+                const int ix_block_end =
+                    bx == num_blocks_x - 1 ? pitch : std::min(1 + (bx + 1) * block_x, nx - 1);
+                for (int iy = iy_start + by * block_y; iy < iy_block_end; ++iy)
+                    std::memset(a + iy * pitch + ix_block_start, 0,
+                                (ix_block_end - ix_block_start) * sizeof(real));
+            }
+        }
+    }
+}
+
+#endif  // JACOBI_CPU_H
@@ -0,0 +1,35 @@
+// Per-domain state of the host driver, sized by the domain count at run time.
+//
+// Every domain owns one domain_state, alone on its cache line: the grids and rows of the domain
+// and the values its thread writes every iteration (the norm of its sweep and, for -rebalance, its
+// sweep time). Packed into plain arrays, the norms of 16 neighbouring domains share a line and
+// every write by one domain invalidates the line in the caches of the others, a cost that grows
+// with the domain count. padded<T> gives the same isolation to per-domain values kept outside
+// domain_state, like the norm slots of the -taskgraph solve.
+#ifndef JACOBI_DOMAIN_H
+#define JACOBI_DOMAIN_H
+
+#include "jacobi_cpu.h"
+
+constexpr size_t DOMAIN_ALIGN_BYTES = 64;
+
+template <typename T>
+struct alignas(DOMAIN_ALIGN_BYTES) padded {
+    T value{};
+};
+
+struct alignas(DOMAIN_ALIGN_BYTES) domain_state {
+    real* a = nullptr;
+    real* a_new = nullptr;
+    real* source = nullptr;   // Scaled source term, nullptr without one
+    int iy_start = 0;         // First and one past the last row of the domain in its grids
+    int iy_end = 0;
+    int iy_start_global = 0;  // Global row of iy_start
+    int chunk_size = 0;
+    int capacity = 0;  // Allocated rows of the grids
+    // Written by the domain's thread
+    real l2_norm = 0.0;
+    double compute_seconds = 0.0;  // Sweep time since the last repartition of -rebalance
+};
+
+#endif  // JACOBI_DOMAIN_H
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <omp.h>
+#include <unistd.h>
+
+#include "jacobi_shm.h"
+#include "jacobi_sync.h"
+#include "jacobi_transport.h"
+
+// Halo transport benchmark: latency and bandwidth of the halo exchange with every transport of
+// jacobi_transport.h, direct and packed, for rows of -minbytes to -maxbytes (1 KB to 1 MB by
+// default, doubling). A step is the exchange of one solver iteration in a ring of two domains:
+// both post the receives of their two halo rows and the sends of their two boundary rows and
+// wait. memcpy runs the two domains as threads of rank 0, shm and mpi as ranks 0 and 1, so shm
+// and mpi need at least two ranks (mpirun -np 2); further ranks idle. The latency is the time of
+// a step, the bandwidth the two rows a domain receives per step over that time. Every case is
+// checked: the received halo rows have to hold the boundary rows of the other domain.
+
+// Bytes moved in the timed steps of a case, which sets their number
+constexpr double BENCH_BYTES_PER_CASE = 256.0 * 1024 * 1024;
+constexpr int BENCH_MIN_STEPS = 100;
+constexpr int BENCH_MAX_STEPS = 10000;
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+// Rows 0 and 3 of grid are the halo rows, 1 and 2 the boundary rows sent to the top and bottom
+// neighbour. Fills the boundary rows with value and the halo rows with zeros.
+static void fill_rows(real* const grid, const int count, const real value) {
+    std::fill(grid, grid + 4 * count, real(0.0));
+    std::fill(grid + count, grid + 3 * count, value);
+}
+
+static bool check_rows(const real* const grid, const int count, const real expected) {
+    for (int i = 0; i < count; ++i)
+        if (grid[i] != expected || grid[3 * count + i] != expected) return false;
+    return true;
+}
+
+// Runs warmup untimed and steps timed exchanges of the rows of grid and returns the time per step.
+// barrier() lines the two domains up before the timed steps.
+template <typename Barrier>
+static double run_steps(halo_transport* transport, real* const grid, const int count,
+                        const int warmup, const int steps, Barrier barrier) {
+    double start = 0.0;
+    for (int step = 0; step < warmup + steps; ++step) {
+        if (step == warmup) {
+            barrier();
+            start = omp_get_wtime();
+        }
+        transport->post_recv(HALO_TOP, grid, count);
+        transport->post_recv(HALO_BOTTOM, grid + 3 * count, count);
+        transport->post_send(HALO_TOP, grid + count, count);
+        transport->post_send(HALO_BOTTOM, grid + 2 * count, count);
+        transport->wait();
+    }
+    return (omp_get_wtime() - start) / steps;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank = 0;
+    int size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const int min_bytes = get_argval<int>(argv, argv + argc, "-minbytes", 1024);
+    const int max_bytes = get_argval<int>(argv, argv + argc, "-maxbytes", 1024 * 1024);
+    const std::string transports =
+        get_argval<std::string>(argv, argv + argc, "-transport", "memcpy,shm,mpi");
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+
+    std::vector<halo_kind> kinds;
+    std::istringstream list(transports);
+    for (std::string name; std::getline(list, name, ',');) {
+        halo_kind kind;
+        if (!halo_parse_kind(name, &kind)) {
+            if (0 == rank) fprintf(stderr, "ERROR: -transport must list memcpy, shm or mpi\n");
+            MPI_Finalize();
+            return -1;
+        }
+        if (HALO_MEMCPY != kind && size < 2) {
+            if (0 == rank) fprintf(stderr, "Skipping %s, it needs two ranks\n", name.c_str());
+            continue;
+        }
+        kinds.push_back(kind);
+    }
+    if (min_bytes < int(sizeof(real)) || max_bytes < min_bytes) {
+        if (0 == rank) fprintf(stderr, "ERROR: -minbytes must be at least 4 and -maxbytes\n");
+        MPI_Finalize();
+        return -1;
+    }
+
+    // Ranks 0 and 1 are the two domains of shm and mpi
+    MPI_Comm pair;
+    MPI_Comm_split(MPI_COMM_WORLD, rank < 2 ? 0 : 1, rank, &pair);
+    const int other = 1 - rank;
+    long job_id = getpid();
+    MPI_Bcast(&job_id, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+
+    if (0 == rank) {
+        if (csv)
+            printf("halo_transport, transport, mode, bytes, latency_us, bandwidth_gbs\n");
+        else
+            printf("%-8s %-8s %10s %14s %16s\n", "transport", "mode", "bytes", "latency us",
+                   "bandwidth GB/s");
+    }
+
+    int result_correct = 1;
+    for (const halo_kind kind : kinds) {
+        for (int mode = HALO_DIRECT; mode <= HALO_PACKED; ++mode) {
+            for (int bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+                const int count = bytes / sizeof(real);
+                const int steps = std::max(
+                    BENCH_MIN_STEPS, std::min(BENCH_MAX_STEPS, int(BENCH_BYTES_PER_CASE / bytes)));
+                const int warmup = steps / 10;
+                double seconds = 0.0;
+                bool correct = true;
+                if (HALO_MEMCPY == kind && 0 == rank) {
+                    const int spins = 2 > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+                    std::vector<std::unique_ptr<halo_transport>> ring =
+                        halo_memcpy_ring(2, count, halo_mode(mode), spins);
+                    std::vector<real> grids[2] = {std::vector<real>(4 * count),
+                                                  std::vector<real>(4 * count)};
+#pragma omp parallel num_threads(2) reduction(&& : correct)
+                    {
+                        const int d = omp_get_thread_num();
+                        fill_rows(grids[d].data(), count, real(d + 1));
+#pragma omp barrier
+                        const double step_seconds =
+                            run_steps(ring[d].get(), grids[d].data(), count, warmup, steps, [] {
+#pragma omp barrier
+                            });
+                        if (0 == d) seconds = step_seconds;
+                        correct = check_rows(grids[d].data(), count, real(2 - d));
+                    }
+                } else if (HALO_MEMCPY != kind && rank < 2) {
+                    std::unique_ptr<halo_transport> transport;
+                    shm_domain own;
+                    shm_domain peer;
+                    real* grid = nullptr;
+                    std::vector<real> grid_storage;
+                    if (HALO_SHM == kind) {
+                        auto segment_name = [&](const int r) {
+                            return "/jacobi_halo_" + std::to_string(job_id) + "_" +
+                                   std::to_string(r);
+                        };
+                        const size_t control_bytes = halo_shm_control_bytes(count);
+                        int ok = shm_create(&own, segment_name(rank), control_bytes, 4, count);
+                        if (ok) halo_shm_init(&own, count);
+                        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, pair);
+                        if (ok)
+                            ok = shm_attach(&peer, segment_name(other), control_bytes, 4, count);
+                        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, pair);
+                        if (own.base) shm_unlink_domain(own);
+                        if (!ok) MPI_Abort(MPI_COMM_WORLD, 1);
+                        const int spins = 2 > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+                        transport = halo_shm_endpoint(own, peer, peer, count, halo_mode(mode),
+                                                      spins);
+                        grid = own.grids[0];
+                    } else {
+                        transport.reset(
+                            new mpi_transport(pair, other, other, count, halo_mode(mode)));
+                        grid_storage.resize(4 * count);
+                        grid = grid_storage.data();
+                    }
+                    fill_rows(grid, count, real(rank + 1));
+                    seconds = run_steps(transport.get(), grid, count, warmup, steps,
+                                        [pair] { MPI_Barrier(pair); });
+                    correct = check_rows(grid, count, real(other + 1));
+                    MPI_Barrier(pair);
+                    transport.reset();
+                    shm_detach(&peer);
+                    shm_detach(&own);
+                }
+                int case_correct = correct;
+                MPI_Allreduce(MPI_IN_PLACE, &case_correct, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+                if (!case_correct) {
+                    if (0 == rank)
+                        fprintf(stderr, "ERROR: %s %s exchange of %d bytes delivered wrong rows\n",
+                                halo_kind_names[kind], halo_mode_names[mode], bytes);
+                    result_correct = 0;
+                    continue;
+                }
+                if (0 == rank) {
+                    const double bandwidth = 2.0 * bytes / seconds * 1.0e-9;
+                    if (csv)
+                        printf("halo_transport, %s, %s, %d, %f, %f\n", halo_kind_names[kind],
+                               halo_mode_names[mode], bytes, seconds * 1.0e6, bandwidth);
+                    else
+                        printf("%-8s %-8s %10d %14.2f %16.2f\n", halo_kind_names[kind],
+                               halo_mode_names[mode], bytes, seconds * 1.0e6, bandwidth);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    MPI_Comm_free(&pair);
+    MPI_Finalize();
+    return result_correct ? 0 : 1;
+}
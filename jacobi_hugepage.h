@@ -0,0 +1,151 @@
+// Huge page allocation of the host grid buffers.
+//
+// hugepage_alloc() maps a buffer with the requested page policy and falls back gracefully:
+//   1g, 2m - explicit huge pages from the hugetlbfs pool (MAP_HUGETLB); if the pool is empty the
+//            allocation falls back to thp
+//   thp    - a 2 MB aligned anonymous mapping advised with MADV_HUGEPAGE, so transparent huge
+//            pages are used even if THP is in "madvise" mode; falls back to none if THP is off
+//   none   - regular pages
+// The mapping is not touched, so the first touch placement of the caller still decides on which
+// NUMA node the (huge) pages land. Buffers are released with hugepage_free(), which also accepts
+// pointers from malloc.
+#ifndef JACOBI_HUGEPAGE_H
+#define JACOBI_HUGEPAGE_H
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+enum hugepage_policy { HUGEPAGE_NONE = 0, HUGEPAGE_THP, HUGEPAGE_2M, HUGEPAGE_1G };
+
+static const char* const hugepage_policy_names[] = {"none", "thp", "2m", "1g"};
+
+constexpr size_t HUGEPAGE_2M_BYTES = size_t(1) << 21;
+constexpr size_t HUGEPAGE_1G_BYTES = size_t(1) << 30;
+
+struct hugepage_mapping {
+    void* ptr;
+    void* base;
+    size_t bytes;
+};
+
+static std::mutex hugepage_mutex;
+static std::vector<hugepage_mapping> hugepage_mappings;
+static bool hugepage_warned = false;
+
+static inline bool hugepage_parse_policy(const std::string& name, hugepage_policy* policy) {
+    for (int p = HUGEPAGE_NONE; p <= HUGEPAGE_1G; ++p) {
+        if (name == hugepage_policy_names[p]) {
+            *policy = hugepage_policy(p);
+            return true;
+        }
+    }
+    return false;
+}
+
+// False if transparent huge pages are disabled ("[never]") or not supported by the kernel.
+static inline bool hugepage_thp_available() {
+    std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    std::getline(in, mode);
+    return !mode.empty() && std::string::npos == mode.find("[never]");
+}
+
+static inline void hugepage_warn_fallback(const hugepage_policy requested,
+                                          const hugepage_policy used) {
+    std::lock_guard<std::mutex> lock(hugepage_mutex);
+    if (hugepage_warned) return;
+    hugepage_warned = true;
+    fprintf(stderr, "WARNING: %s huge pages not available, falling back to %s\n",
+            hugepage_policy_names[requested], hugepage_policy_names[used]);
+}
+
+static inline void hugepage_register(void* ptr, void* base, const size_t bytes) {
+    std::lock_guard<std::mutex> lock(hugepage_mutex);
+    hugepage_mappings.push_back({ptr, base, bytes});
+}
+
+// Allocates bytes with the given policy. *used (if not null) is set to the policy that was
+// actually applied. Returns nullptr only if even regular pages cannot be mapped.
+static inline void* hugepage_alloc(const size_t bytes, const hugepage_policy policy,
+                                   hugepage_policy* used = nullptr) {
+    hugepage_policy applied = policy;
+    if (HUGEPAGE_2M == applied || HUGEPAGE_1G == applied) {
+        const size_t page = HUGEPAGE_1G == applied ? HUGEPAGE_1G_BYTES : HUGEPAGE_2M_BYTES;
+        const int page_shift = HUGEPAGE_1G == applied ? 30 : 21;
+        const size_t map_bytes = (bytes + page - 1) / page * page;
+        void* p = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT),
+                       -1, 0);
+        if (MAP_FAILED != p) {
+            hugepage_register(p, p, map_bytes);
+            if (used) *used = applied;
+            return p;
+        }
+        applied = HUGEPAGE_THP;
+    }
+    if (HUGEPAGE_THP == applied && !hugepage_thp_available()) applied = HUGEPAGE_NONE;
+    if (applied != policy) hugepage_warn_fallback(policy, applied);
+    if (used) *used = applied;
+
+    // Over-map by one huge page so the buffer can start on a 2 MB boundary
+    const size_t align = HUGEPAGE_THP == applied ? HUGEPAGE_2M_BYTES : 0;
+    const size_t map_bytes = bytes + align;
+    void* base = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (MAP_FAILED == base) return nullptr;
+    void* p = base;
+    if (HUGEPAGE_THP == applied) {
+        const uintptr_t aligned =
+            (reinterpret_cast<uintptr_t>(base) + align - 1) & ~uintptr_t(align - 1);
+        p = reinterpret_cast<void*>(aligned);
+        const size_t advise_bytes = (bytes + align - 1) & ~(align - 1);
+        madvise(p, std::min(advise_bytes, map_bytes - (aligned - uintptr_t(base))),
+                MADV_HUGEPAGE);
+    }
+    hugepage_register(p, base, map_bytes);
+    return p;
+}
+
+static inline void hugepage_free(void* p) {
+    if (nullptr == p) return;
+    {
+        std::lock_guard<std::mutex> lock(hugepage_mutex);
+        for (size_t i = 0; i < hugepage_mappings.size(); ++i) {
+            if (hugepage_mappings[i].ptr == p) {
+                munmap(hugepage_mappings[i].base, hugepage_mappings[i].bytes);
+                hugepage_mappings[i] = hugepage_mappings.back();
+                hugepage_mappings.pop_back();
+                return;
+            }
+        }
+    }
+    std::free(p);
+}
+
+// Huge page backed memory of this process in kB: transparent huge pages plus hugetlbfs pages.
+static inline long hugepage_resident_kb() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string line;
+    long total = 0;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0)
+            total += std::atol(line.c_str() + 14);
+        else if (line.compare(0, 16, "Private_Hugetlb:") == 0)
+            total += std::atol(line.c_str() + 16);
+    }
+    return total;
+}
+
+#endif  // JACOBI_HUGEPAGE_H
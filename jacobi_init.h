@@ -0,0 +1,114 @@
+// Initial guesses: field files and interpolation of coarse solutions.
+//
+// A field file holds a dense ny x nx grid (the layout of a_h) behind a 16 byte header: the magic
+// "JACF", the element size (4 or 8) and nx and ny as 32 bit integers. field_load() reads a file of
+// any size and element type into an nx x ny grid, interpolating bilinearly over the unit square
+// if the sizes differ, so the result of a coarse run (-save) can start a finer one (-init). The
+// top and bottom rows of a loaded field are set to the periodic images of the interior, like the
+// halo rows of a solve.
+#ifndef JACOBI_INIT_H
+#define JACOBI_INIT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+constexpr char FIELD_MAGIC[4] = {'J', 'A', 'C', 'F'};
+
+// Sets rows 0 and ny - 1 of a dense field to the periodic images of rows ny - 2 and 1.
+template <typename T>
+static void field_periodic_halos(T* const field, const int nx, const int ny) {
+    std::memcpy(field, field + (ny - 2) * nx, nx * sizeof(T));
+    std::memcpy(field + (ny - 1) * nx, field + nx, nx * sizeof(T));
+}
+
+// Copies columns [1, nx - 1) of rows [first_row, first_row + num_rows) of the dense field into
+// the grid a with row pitch pitch, leaving its boundary columns untouched.
+template <typename T>
+static void field_copy_interior(const T* const field, const int first_row, const int num_rows,
+                                const int nx, T* const a, const int pitch) {
+    for (int iy = 0; iy < num_rows; ++iy)
+        std::memcpy(a + iy * pitch + 1, field + (first_row + iy) * nx + 1, (nx - 2) * sizeof(T));
+}
+
+// Bilinear interpolation of the cnx x cny grid coarse onto the nx x ny grid fine, both spanning
+// the unit square with their first and last rows and columns.
+template <typename S, typename T>
+static void field_interpolate(const S* const coarse, const int cnx, const int cny, T* const fine,
+                              const int nx, const int ny) {
+    for (int iy = 0; iy < ny; ++iy) {
+        const double y = double(iy) * (cny - 1) / (ny - 1);
+        const int cy = std::min(int(y), cny - 2);
+        const double wy = y - cy;
+        for (int ix = 0; ix < nx; ++ix) {
+            const double x = double(ix) * (cnx - 1) / (nx - 1);
+            const int cx = std::min(int(x), cnx - 2);
+            const double wx = x - cx;
+            const S* const c = coarse + cy * cnx + cx;
+            fine[iy * nx + ix] = T((1.0 - wy) * ((1.0 - wx) * c[0] + wx * c[1]) +
+                                   wy * ((1.0 - wx) * c[cnx] + wx * c[cnx + 1]));
+        }
+    }
+}
+
+template <typename T>
+static bool field_save(const std::string& path, const T* const field, const int nx,
+                       const int ny) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (nullptr == f) {
+        fprintf(stderr, "ERROR: cannot write field file %s\n", path.c_str());
+        return false;
+    }
+    const int32_t header[3] = {int32_t(sizeof(T)), nx, ny};
+    bool ok = fwrite(FIELD_MAGIC, sizeof(FIELD_MAGIC), 1, f) == 1 &&
+              fwrite(header, sizeof(header), 1, f) == 1 &&
+              fwrite(field, sizeof(T), size_t(nx) * ny, f) == size_t(nx) * ny;
+    ok = (0 == fclose(f)) && ok;
+    if (!ok) fprintf(stderr, "ERROR: writing field file %s failed\n", path.c_str());
+    return ok;
+}
+
+template <typename S, typename T>
+static bool field_read_data(FILE* f, const int fnx, const int fny, T* const field, const int nx,
+                            const int ny) {
+    std::vector<S> data(size_t(fnx) * fny);
+    if (fread(data.data(), sizeof(S), data.size(), f) != data.size()) return false;
+    if (fnx == nx && fny == ny)
+        std::copy(data.begin(), data.end(), field);
+    else
+        field_interpolate(data.data(), fnx, fny, field, nx, ny);
+    return true;
+}
+
+// Reads the field file path into the dense nx x ny array field, see above.
+template <typename T>
+static bool field_load(const std::string& path, T* const field, const int nx, const int ny) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (nullptr == f) {
+        fprintf(stderr, "ERROR: cannot read field file %s\n", path.c_str());
+        return false;
+    }
+    char magic[4];
+    int32_t header[3];
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+              0 == std::memcmp(magic, FIELD_MAGIC, sizeof(magic)) &&
+              fread(header, sizeof(header), 1, f) == 1 && header[1] >= 2 && header[2] >= 2;
+    if (ok && 4 == header[0])
+        ok = field_read_data<float>(f, header[1], header[2], field, nx, ny);
+    else if (ok && 8 == header[0])
+        ok = field_read_data<double>(f, header[1], header[2], field, nx, ny);
+    else
+        ok = false;
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "ERROR: %s is not a valid field file\n", path.c_str());
+        return false;
+    }
+    field_periodic_halos(field, nx, ny);
+    return true;
+}
+
+#endif  // JACOBI_INIT_H
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <mpi.h>
+#include <omp.h>
+#include <unistd.h>
+
+#include "jacobi_cpu.h"
+#include "jacobi_partition.h"
+#include "jacobi_pitch.h"
+#include "jacobi_shm.h"
+#include "jacobi_sync.h"
+#include "jacobi_transport.h"
+
+// Distributed memory backend of the row decomposition: every MPI rank owns a row chunk of the
+// global grid with one halo row on each side, like a domain of jacobi_multi_CPU_OpenMP.cpp, and
+// sweeps it with a team of -nthreads OpenMP threads. The ranks form a ring that is periodic in y.
+// An iteration posts the receives of both halo rows, updates the two boundary rows of the chunk,
+// posts their sends to both neighbours, and sweeps the interior rows while the rows are in
+// flight. The halo rows go through the transport of -transport (jacobi_transport.h): mpi
+// (MPI_Isend / MPI_Irecv) or, for ranks on one node, shm, where the grids live in POSIX shared
+// memory and a rank writes its boundary rows straight into the halo rows of its neighbours'
+// mapped grids. -packed sends the rows through buffers instead. On norm check iterations the
+// squared norm of the rank is summed with MPI_Iallreduce, which completes together with the halo
+// exchange, so the reduction latency overlaps the halo latency instead of adding to it. Rank 0
+// runs the single domain reference and checks the gathered result.
+
+#define MPI_REAL_TYPE MPI_FLOAT
+static_assert(sizeof(real) == sizeof(float), "MPI_REAL_TYPE does not match real");
+
+#define MPI_CALL(call)                                                                       \
+    {                                                                                        \
+        const int mpi_status = call;                                                         \
+        if (MPI_SUCCESS != mpi_status) {                                                     \
+            char mpi_error_string[MPI_MAX_ERROR_STRING];                                     \
+            int mpi_error_string_length = 0;                                                 \
+            MPI_Error_string(mpi_status, mpi_error_string, &mpi_error_string_length);        \
+            fprintf(stderr, "ERROR: MPI call \"%s\" in line %d of file %s failed: %s\n",     \
+                    #call, __LINE__, __FILE__, mpi_error_string);                            \
+            MPI_Abort(MPI_COMM_WORLD, mpi_status);                                           \
+        }                                                                                    \
+    }
+
+double single_cpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real tolerance);
+
+bool check_result(const real* const a_ref_h, const real* const a_h, const int nx, const int ny) {
+    for (int iy = 1; iy < (ny - 1); ++iy) {
+        for (int ix = 1; ix < (nx - 1); ++ix) {
+            if (std::fabs(a_ref_h[iy * nx + ix] - a_h[iy * nx + ix]) > tol) {
+                fprintf(stderr,
+                        "ERROR: a[%d * %d + %d] = %f does not match %f "
+                        "(reference)\n",
+                        iy, nx, ix, a_h[iy * nx + ix], a_ref_h[iy * nx + ix]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    int thread_level = MPI_THREAD_SINGLE;
+    MPI_CALL(MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level));
+    int rank = 0;
+    int size = 1;
+    MPI_CALL(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+    MPI_CALL(MPI_Comm_size(MPI_COMM_WORLD, &size));
+
+    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    const int nccheck = get_argval<int>(argv, argv + argc, "-nccheck", 1);
+    const int nx = get_argval<int>(argv, argv + argc, "-nx", 7168);
+    const int ny = get_argval<int>(argv, argv + argc, "-ny", 7168);
+    const int num_threads = get_argval<int>(argv, argv + argc, "-nthreads", 1);
+    const int block_x = get_argval<int>(argv, argv + argc, "-blockx", 0);
+    const int block_y = get_argval<int>(argv, argv + argc, "-blocky", 0);
+    const std::string weights_spec = get_argval<std::string>(argv, argv + argc, "-weights", "");
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+    const bool noref = get_arg(argv, argv + argc, "-noref");
+    const std::string transport_name =
+        get_argval<std::string>(argv, argv + argc, "-transport", "mpi");
+    const halo_mode mode = get_arg(argv, argv + argc, "-packed") ? HALO_PACKED : HALO_DIRECT;
+    const real tolerance = get_argval<real>(argv, argv + argc, "-tol", tol);
+
+    std::vector<double> weights;
+    if (!weights_spec.empty() &&
+        (!partition_parse_list(weights_spec, &weights) || int(weights.size()) != size)) {
+        if (0 == rank) fprintf(stderr, "ERROR: -weights must be a list of one weight per rank\n");
+        MPI_CALL(MPI_Finalize());
+        return -1;
+    }
+    halo_kind transport_kind;
+    if (!halo_parse_kind(transport_name, &transport_kind) || HALO_MEMCPY == transport_kind) {
+        if (0 == rank) fprintf(stderr, "ERROR: -transport must be mpi or shm\n");
+        MPI_CALL(MPI_Finalize());
+        return -1;
+    }
+    const bool shm = HALO_SHM == transport_kind;
+    if (size > (ny - 2) || num_threads < 1 || nccheck < 1) {
+        if (0 == rank)
+            fprintf(stderr, "ERROR: at most ny - 2 ranks, -nthreads and -nccheck at least 1\n");
+        MPI_CALL(MPI_Finalize());
+        return -1;
+    }
+
+    omp_set_dynamic(0);
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    // Same decomposition as the domains of the host driver: chunk_size_low or chunk_size_low + 1
+    // rows per rank, or rows in proportion to -weights
+    std::vector<int> starts(size + 1);
+    if (!weights.empty()) {
+        partition_weighted(weights, ny - 2, 1, starts.data());
+    } else {
+        const int chunk_size_low = (ny - 2) / size;
+        const int num_ranks_low = size * chunk_size_low + size - (ny - 2);
+        for (int r = 0; r <= size; ++r)
+            starts[r] = 1 + r * chunk_size_low + std::max(0, r - num_ranks_low);
+    }
+    const int chunk_size = starts[rank + 1] - starts[rank];
+    const int iy_start_global = starts[rank];
+    const int iy_start = 1;
+    const int iy_end = iy_start + chunk_size;
+    const int top = rank > 0 ? rank - 1 : (size - 1);
+    const int bottom = (rank + 1) % size;
+
+    real* a_ref_h = nullptr;
+    real* a_h = nullptr;
+    double runtime_serial = 0.0;
+    if (0 == rank) {
+        a_ref_h = (real*)malloc(size_t(nx) * ny * sizeof(real));
+        a_h = (real*)malloc(size_t(nx) * ny * sizeof(real));
+        if (!noref)
+            runtime_serial = single_cpu(nx, ny, iter_max, a_ref_h, nccheck, !csv, tolerance);
+    }
+
+    // -transport shm: every rank creates the segment with its grids and the mailboxes of its halo
+    // rows and maps those of its neighbours. The names are unlinked as soon as all ranks mapped
+    // their neighbours.
+    shm_domain shm_own;
+    shm_domain shm_top;
+    shm_domain shm_bottom;
+    real* a;
+    real* a_new;
+    if (shm) {
+        MPI_Comm node_comm;
+        int node_size = 0;
+        MPI_CALL(MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                                     &node_comm));
+        MPI_CALL(MPI_Comm_size(node_comm, &node_size));
+        MPI_CALL(MPI_Comm_free(&node_comm));
+        long job_id = getpid();
+        MPI_CALL(MPI_Bcast(&job_id, 1, MPI_LONG, 0, MPI_COMM_WORLD));
+        auto segment_name = [job_id](const int r) {
+            return "/jacobi_" + std::to_string(job_id) + "_" + std::to_string(r);
+        };
+        auto segment_rows = [&starts](const int r) { return starts[r + 1] - starts[r] + 2; };
+        const size_t control_bytes = halo_shm_control_bytes(nx);
+        int ok = node_size == size;
+        if (!ok && 0 == rank)
+            fprintf(stderr, "ERROR: -transport shm needs all ranks on one node\n");
+        if (ok)
+            ok = shm_create(&shm_own, segment_name(rank), control_bytes, chunk_size + 2, pitch);
+        if (ok) halo_shm_init(&shm_own, nx);
+        MPI_CALL(MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD));
+        if (ok)
+            ok = shm_attach(&shm_top, segment_name(top), control_bytes, segment_rows(top),
+                            pitch) &&
+                 shm_attach(&shm_bottom, segment_name(bottom), control_bytes,
+                            segment_rows(bottom), pitch);
+        MPI_CALL(MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD));
+        if (shm_own.base) shm_unlink_domain(shm_own);
+        if (!ok) {
+            for (shm_domain* domain : {&shm_bottom, &shm_top, &shm_own}) shm_detach(domain);
+            free(a_h);
+            free(a_ref_h);
+            MPI_CALL(MPI_Finalize());
+            return -1;
+        }
+        a = shm_own.grids[0];
+        a_new = shm_own.grids[1];
+    } else {
+        a = (real*)malloc(size_t(pitch) * (chunk_size + 2) * sizeof(real));
+        a_new = (real*)malloc(size_t(pitch) * (chunk_size + 2) * sizeof(real));
+    }
+    first_touch(a, iy_start, iy_end, nx, pitch, num_threads, block_x, block_y, nullptr);
+    first_touch(a_new, iy_start, iy_end, nx, pitch, num_threads, block_x, block_y, nullptr);
+
+    // Set diriclet boundary conditions on left and right boarder
+    initialize_boundaries(a_new, a, PI, iy_start_global - 1, nx, pitch, chunk_size + 2, ny);
+
+    if (!csv && 0 == rank)
+        printf(
+            "Jacobi relaxation: %d iterations on %d x %d mesh with norm check every %d "
+            "iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    // Sweeps rows [begin, end) of the chunk, which may be empty
+    auto sweep = [&](const int begin, const int end, const bool calculate_norm) -> real {
+        if (begin >= end) return 0.0;
+        return jacobi_kernel(a_new, a, begin, end, nx, pitch, num_threads, block_x, block_y,
+                             nullptr, calculate_norm);
+    };
+
+    // Like the -p2p solve, oversubscribed ranks sleep right away instead of spinning
+    const int spins = size * num_threads > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+    std::unique_ptr<halo_transport> transport(
+        shm ? halo_shm_endpoint(shm_own, shm_top, shm_bottom, nx, mode, spins)
+            : std::unique_ptr<halo_transport>(new mpi_transport(MPI_COMM_WORLD, top, bottom, nx,
+                                                                mode)));
+
+    int iter = 0;
+    real l2_norm = 1.0;
+
+    MPI_CALL(MPI_Barrier(MPI_COMM_WORLD));
+    const double start = MPI_Wtime();
+    while (l2_norm > tolerance && iter < iter_max) {
+        const bool calculate_norm = (iter % nccheck) == 0 || (!csv && (iter % 100) == 0);
+
+        transport->post_recv(HALO_TOP, a_new, nx);
+        transport->post_recv(HALO_BOTTOM, a_new + iy_end * pitch, nx);
+
+        // Boundary rows first, a chunk of one row has only one
+        real l2_norm_sq = sweep(iy_start, iy_start + 1, calculate_norm);
+        l2_norm_sq += sweep(std::max(iy_start + 1, iy_end - 1), iy_end, calculate_norm);
+        transport->post_send(HALO_TOP, a_new + iy_start * pitch, nx);
+        transport->post_send(HALO_BOTTOM, a_new + (iy_end - 1) * pitch, nx);
+
+        // Interior rows while the halo rows are in flight
+        l2_norm_sq += sweep(iy_start + 1, iy_end - 1, calculate_norm);
+
+        real global_l2_norm_sq = 0.0;
+        MPI_Request norm_request = MPI_REQUEST_NULL;
+        if (calculate_norm)
+            MPI_CALL(MPI_Iallreduce(&l2_norm_sq, &global_l2_norm_sq, 1, MPI_REAL_TYPE, MPI_SUM,
+                                    MPI_COMM_WORLD, &norm_request));
+        transport->wait();
+        MPI_CALL(MPI_Wait(&norm_request, MPI_STATUS_IGNORE));
+
+        if (calculate_norm) {
+            l2_norm = std::sqrt(global_l2_norm_sq);
+            if (!csv && 0 == rank && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        std::swap(a_new, a);
+        iter++;
+    }
+    MPI_CALL(MPI_Barrier(MPI_COMM_WORLD));
+    const double stop = MPI_Wtime();
+
+    // Gather the interior rows on rank 0, densely with nx elements per row
+    std::vector<real> rows(size_t(nx) * chunk_size);
+    for (int iy = 0; iy < chunk_size; ++iy)
+        std::memcpy(&rows[size_t(iy) * nx], a + (iy_start + iy) * pitch, nx * sizeof(real));
+    std::vector<int> counts(size);
+    std::vector<int> displs(size);
+    for (int r = 0; r < size; ++r) {
+        counts[r] = (starts[r + 1] - starts[r]) * nx;
+        displs[r] = starts[r] * nx;
+    }
+    MPI_CALL(MPI_Gatherv(rows.data(), chunk_size * nx, MPI_REAL_TYPE, a_h, counts.data(),
+                         displs.data(), MPI_REAL_TYPE, 0, MPI_COMM_WORLD));
+
+    int result_correct = 1;
+    if (0 == rank && !noref) result_correct = check_result(a_ref_h, a_h, nx, ny);
+    MPI_CALL(MPI_Bcast(&result_correct, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+    if (result_correct && 0 == rank) {
+        if (csv) {
+            printf("mpi_cpu, %d, %d, %d, %d, %d, %d, %f, %f, %d, %d, %d\n", nx, ny, iter_max,
+                   nccheck, size, num_threads, (stop - start), runtime_serial, iter, block_x,
+                   block_y);
+        } else {
+            printf("Num ranks: %d (%d threads each, %s %s halos).\n", size, num_threads,
+                   halo_kind_names[transport_kind], halo_mode_names[mode]);
+            if (!weights.empty()) {
+                printf("Rows per rank:");
+                for (int r = 0; r < size; ++r) printf(" %d", starts[r + 1] - starts[r]);
+                printf("\n");
+            }
+            const double lups = double(nx - 2) * (ny - 2) * iter;
+            if (noref) {
+                printf("%dx%d: %d ranks: %8.4f s, %d iterations, %8.2f MLUPS\n", ny, nx, size,
+                       (stop - start), iter, lups / (stop - start) * 1.0e-6);
+            } else {
+                printf(
+                    "%dx%d: 1 rank: %8.4f s, %d ranks: %8.4f s, speedup: %8.2f, "
+                    "efficiency: %8.2f \n",
+                    ny, nx, runtime_serial, size, (stop - start),
+                    runtime_serial / (stop - start),
+                    runtime_serial / (size * (stop - start)) * 100);
+            }
+        }
+    }
+
+    transport.reset();
+    if (shm) {
+        for (shm_domain* domain : {&shm_bottom, &shm_top, &shm_own}) shm_detach(domain);
+    } else {
+        free(a_new);
+        free(a);
+    }
+    free(a_h);
+    free(a_ref_h);
+
+    MPI_CALL(MPI_Finalize());
+    return result_correct ? 0 : 1;
+}
+
+// Single domain reference with the default boundary conditions
+double single_cpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real tolerance) {
+    const int iy_start = 1;
+    const int iy_end = (ny - 1);
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    real* a = (real*)malloc(size_t(pitch) * ny * sizeof(real));
+    real* a_new = (real*)malloc(size_t(pitch) * ny * sizeof(real));
+    std::memset(a, 0, size_t(pitch) * ny * sizeof(real));
+    std::memset(a_new, 0, size_t(pitch) * ny * sizeof(real));
+
+    // Set diriclet boundary conditions on left and right boarder
+    initialize_boundaries(a, a_new, PI, 0, nx, pitch, ny, ny);
+
+    if (print)
+        printf(
+            "Single domain jacobi relaxation: %d iterations on %d x %d mesh with "
+            "norm "
+            "check every %d iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    int iter = 0;
+    real l2_norm = 1.0;
+
+    const double start = omp_get_wtime();
+    while (l2_norm > tolerance && iter < iter_max) {
+        const bool calculate_norm = (iter % nccheck) == 0 || (print && ((iter % 100) == 0));
+        const real l2_norm_sq = jacobi_kernel(a_new, a, iy_start, iy_end, nx, pitch, 1, 0, 0,
+                                              nullptr, calculate_norm);
+
+        // Apply periodic boundary conditions
+        std::memcpy(a_new, a_new + (iy_end - 1) * pitch, nx * sizeof(real));
+        std::memcpy(a_new + iy_end * pitch, a_new + iy_start * pitch, nx * sizeof(real));
+
+        if (calculate_norm) {
+            l2_norm = std::sqrt(l2_norm_sq);
+            if (print && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        std::swap(a_new, a);
+        iter++;
+    }
+    const double stop = omp_get_wtime();
+
+    for (int iy = 0; iy < ny; ++iy)
+        std::memcpy(a_ref_h + iy * nx, a + iy * pitch, nx * sizeof(real));
+
+    free(a_new);
+    free(a);
+    return (stop - start);
+}
@@ -0,0 +1,1635 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_bc.h"
+#include "jacobi_cpu.h"
+#include "jacobi_domain.h"
+#include "jacobi_hugepage.h"
+#include "jacobi_init.h"
+#include "jacobi_numa.h"
+#include "jacobi_ooc.h"
+#include "jacobi_partition.h"
+#include "jacobi_perf.h"
+#include "jacobi_pitch.h"
+#include "jacobi_pool.h"
+#include "jacobi_reduce.h"
+#include "jacobi_solver.h"
+#include "jacobi_sync.h"
+#include "jacobi_taskgraph.h"
+#include "jacobi_trace.h"
+#include "jacobi_tune.h"
+
+#ifdef USE_NVTX
+#include <nvToolsExt.h>
+
+const uint32_t colors[] = {0x0000ff00, 0x000000ff, 0x00ffff00, 0x00ff00ff,
+                           0x0000ffff, 0x00ff0000, 0x00ffffff};
+const int num_colors = sizeof(colors) / sizeof(uint32_t);
+
+#define PUSH_RANGE(name, cid)                              \
+    {                                                      \
+        int color_id = cid;                                \
+        color_id = color_id % num_colors;                  \
+        nvtxEventAttributes_t eventAttrib = {0};           \
+        eventAttrib.version = NVTX_VERSION;                \
+        eventAttrib.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;  \
+        eventAttrib.colorType = NVTX_COLOR_ARGB;           \
+        eventAttrib.color = colors[color_id];              \
+        eventAttrib.messageType = NVTX_MESSAGE_TYPE_ASCII; \
+        eventAttrib.message.ascii = name;                  \
+        nvtxRangePushEx(&eventAttrib);                     \
+    }
+#define POP_RANGE nvtxRangePop();
+#else
+#define PUSH_RANGE(name, cid)
+#define POP_RANGE
+#endif
+
+// Host backend of the multi-GPU driver: every domain is an OpenMP thread (optionally leading a
+// nested team of -nthreads threads) that owns a row chunk with one halo row on each side, exactly
+// like a device in jacobi_multi_GPU_CUDA.cu. Halo rows are pushed into the neighbours' buffers
+// with memcpy.
+
+// Roofline model of one lattice update: the minimal traffic is one load of a and one store of
+// a_new, the stencil is 3 adds and 1 multiply and the norm adds a subtract, a multiply and an add.
+constexpr int bytes_per_lup = 2 * sizeof(real);
+constexpr int flops_per_lup = 7;
+
+// -taskgraph: parts (bands of rows) of a domain sweep per thread, so that work stealing can
+// balance the domains
+constexpr int TASKGRAPH_PARTS_PER_THREAD = 4;
+
+// -rebalance: a repartition has to make the slowest domain at least 5 % faster, and every domain
+// has a quarter of its rows as spare rows on each side, so that rows moving in from the
+// neighbours usually fit without reallocating the grids
+constexpr double REBALANCE_MIN_GAIN = 0.05;
+constexpr int REBALANCE_SPARE_FRACTION = 4;
+
+// Host staging buffers (reference and result arrays, grids of the reference solve and band
+// buffers of the out-of-core solve) with the -hugepages policy, see jacobi_pool.h. The domain
+// grids are not pooled, their pages have to be placed by first touch.
+hugepage_policy staging_hugepages = HUGEPAGE_NONE;
+staging_pool host_pool([](size_t bytes) { return hugepage_alloc(bytes, staging_hugepages); },
+                       [](void* p) { hugepage_free(p); });
+
+double single_cpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real tolerance,
+                  const real* const init, const boundary_conditions& bc,
+                  const real* const source);
+
+double ooc_cpu(const std::string& file, const int nx, const int ny, const int iter_max,
+               const int nccheck, const int band_rows, const int num_steps, const int num_threads,
+               const int block_x, const int block_y, real* const a_h, const bool print,
+               const real tolerance, int* const iterations, int* const bands);
+
+int taskgraph_cpu(task_pool* pool, std::vector<domain_state>& domains, const int nx, const int ny,
+                  const int pitch, const int iter_max, const int nccheck, const int graph_iters,
+                  const real tolerance, const int num_threads, const boundary_conditions& bc,
+                  const bool print, real* const l2_norm_out);
+
+std::vector<double> calibrate_weights(const int num_domains, const int nx, const int ny,
+                                      const int pitch, const std::vector<int>& domain_threads,
+                                      const std::vector<cpu_set_t>& affinity, const int block_x,
+                                      const int block_y);
+
+int p2p_cpu(std::vector<domain_state>& domains, const int nx, const int ny, const int pitch,
+            const int iter_max, const int nccheck, const real tolerance, const int num_threads,
+            const int block_x, const int block_y, const std::vector<cpu_set_t>& affinity,
+            const boundary_conditions& bc, const bool print, real* const l2_norm_out);
+
+bool check_result(const real* const a_ref_h, const real* const a_h, const int nx, const int ny) {
+    for (int iy = 1; iy < (ny - 1); ++iy) {
+        for (int ix = 1; ix < (nx - 1); ++ix) {
+            if (std::fabs(a_ref_h[iy * nx + ix] - a_h[iy * nx + ix]) > tol) {
+                fprintf(stderr,
+                        "ERROR: a[%d * %d + %d] = %f does not match %f "
+                        "(reference)\n",
+                        iy, nx, ix, a_h[iy * nx + ix], a_ref_h[iy * nx + ix]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    // -graph K replays graphs of K iterations that check the norm once
+    const int graph_iters = get_argval<int>(argv, argv + argc, "-graph", 0);
+    const int nccheck =
+        graph_iters > 0 ? graph_iters : get_argval<int>(argv, argv + argc, "-nccheck", 1);
+    const int nx = get_argval<int>(argv, argv + argc, "-nx", 7168);
+    const int ny = get_argval<int>(argv, argv + argc, "-ny", 7168);
+    const int num_domains = get_argval<int>(argv, argv + argc, "-ndomains", omp_get_max_threads());
+    // -nthreads takes the threads of every domain or a list with one count per domain
+    const std::string threads_spec = get_argval<std::string>(argv, argv + argc, "-nthreads", "1");
+    int block_x = get_argval<int>(argv, argv + argc, "-blockx", 0);
+    int block_y = get_argval<int>(argv, argv + argc, "-blocky", 0);
+    const std::string tune_db =
+        get_argval<std::string>(argv, argv + argc, "-tunedb", "jacobi_tuning.db");
+    const bool autotune = get_arg(argv, argv + argc, "-autotune");
+    const bool inplace = get_arg(argv, argv + argc, "-inplace");
+    const bool taskgraph = get_arg(argv, argv + argc, "-taskgraph") || graph_iters > 0;
+    const bool p2p = get_arg(argv, argv + argc, "-p2p");
+    const int rebalance = get_argval<int>(argv, argv + argc, "-rebalance", 0);
+    const std::string weights_spec = get_argval<std::string>(argv, argv + argc, "-weights", "");
+    const std::string ooc_file = get_argval<std::string>(argv, argv + argc, "-ooc", "");
+    const int ooc_rows = get_argval<int>(argv, argv + argc, "-oocrows", 1024);
+    const int ooc_steps = get_argval<int>(argv, argv + argc, "-oocsteps", 8);
+    const std::string affinity_name =
+        get_argval<std::string>(argv, argv + argc, "-affinity", "none");
+    const std::string hugepages_name =
+        get_argval<std::string>(argv, argv + argc, "-hugepages", "none");
+    const std::string trace_file = get_argval<std::string>(argv, argv + argc, "-trace", "");
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+    const bool perf = get_arg(argv, argv + argc, "-perf");
+    const bool noref = get_arg(argv, argv + argc, "-noref");
+    const real tolerance = get_argval<real>(argv, argv + argc, "-tol", tol);
+    const std::string init_file = get_argval<std::string>(argv, argv + argc, "-init", "");
+    const int init_coarse = get_argval<int>(argv, argv + argc, "-initcoarse", 0);
+    const std::string save_file = get_argval<std::string>(argv, argv + argc, "-save", "");
+    const std::string source_file = get_argval<std::string>(argv, argv + argc, "-source", "");
+    const bool source_value_set = get_arg(argv, argv + argc, "-sourceval");
+    const real source_value = get_argval<real>(argv, argv + argc, "-sourceval", 0.0);
+
+    if (num_domains < 1 || num_domains > (ny - 2)) {
+        fprintf(stderr, "ERROR: -ndomains must be at least 1 and at most ny - 2\n");
+        return -1;
+    }
+    if (nccheck < 1) {
+        fprintf(stderr, "ERROR: -nccheck must be at least 1\n");
+        return -1;
+    }
+    if (!ooc_file.empty() && (ooc_rows < 1 || ooc_steps < 1 || ooc_steps > (ny - 2))) {
+        fprintf(stderr, "ERROR: -oocrows must be at least 1 and -oocsteps in [1, ny - 2]\n");
+        return -1;
+    }
+    if (!ooc_file.empty() && (!init_file.empty() || init_coarse || !save_file.empty())) {
+        fprintf(stderr, "ERROR: -init, -initcoarse and -save are not supported with -ooc\n");
+        return -1;
+    }
+    if (!init_file.empty() && init_coarse) {
+        fprintf(stderr, "ERROR: -init and -initcoarse are mutually exclusive\n");
+        return -1;
+    }
+    if (init_coarse && (init_coarse < 2 || (nx - 1) / init_coarse < 2 ||
+                        (ny - 1) / init_coarse < 3)) {
+        fprintf(stderr, "ERROR: -initcoarse must be at least 2 and leave a 3 x 4 coarse grid\n");
+        return -1;
+    }
+    if (graph_iters < 0) {
+        fprintf(stderr, "ERROR: -graph must be at least 1\n");
+        return -1;
+    }
+    if ((taskgraph || p2p) && (inplace || !ooc_file.empty())) {
+        fprintf(stderr, "ERROR: -taskgraph and -p2p are not supported with -inplace and -ooc\n");
+        return -1;
+    }
+    if (taskgraph && p2p) {
+        fprintf(stderr, "ERROR: -taskgraph and -p2p are mutually exclusive\n");
+        return -1;
+    }
+    std::vector<double> thread_list;
+    if (!partition_parse_list(threads_spec, &thread_list) ||
+        (thread_list.size() != 1 && int(thread_list.size()) != num_domains) ||
+        std::any_of(thread_list.begin(), thread_list.end(),
+                    [](const double t) { return t != std::floor(t); })) {
+        fprintf(stderr, "ERROR: -nthreads must be a thread count or a list of one per domain\n");
+        return -1;
+    }
+    int num_threads = int(*std::max_element(thread_list.begin(), thread_list.end()));
+    const bool mixed_threads = std::any_of(thread_list.begin(), thread_list.end(),
+                                           [&](const double t) { return t != num_threads; });
+    if (mixed_threads && (autotune || taskgraph || p2p || !ooc_file.empty())) {
+        fprintf(stderr,
+                "ERROR: different thread counts per domain are not supported with -autotune, "
+                "-taskgraph, -p2p and -ooc\n");
+        return -1;
+    }
+    // -weights: a weight per domain, or calibrate to measure the speed of every domain
+    const bool calibrate = "calibrate" == weights_spec;
+    std::vector<double> weights;
+    if (!weights_spec.empty() && !calibrate &&
+        (!partition_parse_list(weights_spec, &weights) || int(weights.size()) != num_domains)) {
+        fprintf(stderr, "ERROR: -weights must be calibrate or a list of one weight per domain\n");
+        return -1;
+    }
+    if (!weights_spec.empty() && !ooc_file.empty()) {
+        fprintf(stderr, "ERROR: -weights is not supported with -ooc\n");
+        return -1;
+    }
+    if (rebalance < 0 ||
+        (rebalance && (inplace || !ooc_file.empty() || taskgraph || p2p))) {
+        fprintf(stderr,
+                "ERROR: -rebalance must be at least 1 and is not supported with -inplace, -ooc, "
+                "-taskgraph and -p2p\n");
+        return -1;
+    }
+    boundary_conditions bc;
+    const char* const edge_options[4] = {"-bcleft", "-bcright", "-bctop", "-bcbottom"};
+    edge_bc* const edges[4] = {&bc.left, &bc.right, &bc.top, &bc.bottom};
+    for (int edge = 0; edge < 4; ++edge) {
+        const std::string spec = get_argval<std::string>(argv, argv + argc, edge_options[edge], "");
+        // sin is a boundary of the columns
+        const bool column = edge < 2;
+        if (!spec.empty() && !bc_parse_edge(spec, column, edges[edge])) {
+            fprintf(stderr,
+                    "ERROR: %s must be %sdirichlet[:v], neumann[:g], robin:k[:g] or periodic\n",
+                    edge_options[edge], column ? "sin, " : "");
+            return -1;
+        }
+    }
+    if (!bc_valid(bc)) {
+        fprintf(stderr, "ERROR: periodic must be set on both edges of a direction\n");
+        return -1;
+    }
+    const bool has_source = !source_file.empty() || source_value_set;
+    if (has_source && nx != ny) {
+        fprintf(stderr, "ERROR: -source and -sourceval need a square grid (nx == ny)\n");
+        return -1;
+    }
+    if ((!bc_is_default(bc) || has_source) && (inplace || !ooc_file.empty() || init_coarse)) {
+        fprintf(stderr,
+                "ERROR: boundary conditions and sources are not supported with -inplace, -ooc "
+                "and -initcoarse\n");
+        return -1;
+    }
+    const bool periodic_y = BC_PERIODIC == bc.top.type;
+    numa_policy affinity_policy;
+    if (!numa_parse_policy(affinity_name, &affinity_policy)) {
+        fprintf(stderr, "ERROR: -affinity must be one of none, compact, scatter or numa\n");
+        return -1;
+    }
+    hugepage_policy hugepages;
+    if (!hugepage_parse_policy(hugepages_name, &hugepages)) {
+        fprintf(stderr, "ERROR: -hugepages must be one of none, thp, 2m or 1g\n");
+        return -1;
+    }
+
+    if (!trace_file.empty()) trace_enable();
+    const bool perf_available = perf && perf_enable();
+
+    omp_set_dynamic(0);
+    omp_set_max_active_levels(2);
+
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    // Grids, rows and norm of every domain, each on cache lines of its own (jacobi_domain.h)
+    std::vector<domain_state> domains(num_domains);
+    real* a_ref_h;
+    real* a_h;
+    double runtime_serial = 0.0;
+
+    hugepage_policy hugepages_used = hugepages;
+
+    // -inplace keeps a single buffer per domain, followed by a second slot for each halo row: the
+    // sweep of iteration iter reads the halo slots iter % 2 while the neighbours push into the
+    // slots (iter + 1) % 2, so a push never overwrites a halo row that is still being read.
+    const int num_halo_rows = inplace ? 4 : 2;
+    auto halo_top_row = [&](const int dev_id, const int slot) {
+        return 0 == slot ? domains[dev_id].iy_start - 1 : domains[dev_id].iy_end + 1;
+    };
+    auto halo_bottom_row = [&](const int dev_id, const int slot) {
+        return 0 == slot ? domains[dev_id].iy_end : domains[dev_id].iy_end + 2;
+    };
+
+    staging_hugepages = hugepages;
+    a_ref_h = (real*)pool_alloc(&host_pool, nx * ny * sizeof(real));
+    a_h = (real*)pool_alloc(&host_pool, nx * ny * sizeof(real));
+
+    // Initial guess (zero if empty): a saved field, interpolated if its size differs, or the
+    // interpolated solution of the problem on a grid coarsened by -initcoarse
+    std::vector<real> init;
+    if (!init_file.empty()) {
+        init.resize(size_t(nx) * ny);
+        if (!field_load(init_file, init.data(), nx, ny)) return -1;
+        if (!csv) printf("Initial guess from %s\n", init_file.c_str());
+    } else if (init_coarse) {
+        const int coarse_nx = (nx - 1) / init_coarse + 1;
+        const int coarse_ny = (ny - 1) / init_coarse + 1;
+        solver_options options;
+        options.num_threads = std::max(1, num_domains * num_threads);
+        options.nccheck = nccheck;
+        Solver coarse(options);
+        std::vector<real> coarse_field(size_t(coarse_nx) * coarse_ny);
+        const double coarse_start = omp_get_wtime();
+        coarse.setup(coarse_nx, coarse_ny);
+        const int coarse_iters = coarse.solve(iter_max, tolerance);
+        coarse.get_field(coarse_field.data());
+        init.resize(size_t(nx) * ny);
+        field_interpolate(coarse_field.data(), coarse_nx, coarse_ny, init.data(), nx, ny);
+        field_periodic_halos(init.data(), nx, ny);
+        if (!csv)
+            printf("Initial guess from a %d x %d coarse solve: %d iterations, %8.4f s\n",
+                   coarse_ny, coarse_nx, coarse_iters, omp_get_wtime() - coarse_start);
+    }
+    const real* const init_h = init.empty() ? nullptr : init.data();
+
+    // Source term of -laplace(u) = f from a field file or a constant, scaled for the sweep
+    std::vector<real> source_field;
+    if (has_source) {
+        source_field.assign(size_t(nx) * ny, source_value);
+        if (!source_file.empty() && !field_load(source_file, source_field.data(), nx, ny))
+            return -1;
+        bc_scale_source(source_field.data(), nx, ny);
+    }
+    const real* const source_h = has_source ? source_field.data() : nullptr;
+
+    if (!noref)
+        runtime_serial = single_cpu(nx, ny, iter_max, a_ref_h, nccheck, !csv, tolerance, init_h,
+                                    bc, source_h);
+    // The grids of the reference solve are not needed again, release them before the solve's own
+    pool_trim(&host_pool);
+
+    // -ooc streams the grid through a file instead of decomposing it into domains
+    if (!ooc_file.empty()) {
+        int iter = 0;
+        int num_bands = 0;
+        const double runtime =
+            ooc_cpu(ooc_file, nx, ny, iter_max, nccheck, ooc_rows, ooc_steps, num_threads,
+                    block_x, block_y, noref ? nullptr : a_h, !csv, tolerance, &iter, &num_bands);
+        const bool result_correct =
+            runtime >= 0.0 && (noref || check_result(a_ref_h, a_h, nx, ny));
+        const double lups = double(nx - 2) * double(ny - 2) * iter;
+        if (result_correct && csv) {
+            printf("openmp_cpu_ooc, %d, %d, %d, %d, %d, %d, %f, %f, %d, %d, %d\n", nx, ny,
+                   iter_max, nccheck, num_bands, num_threads, runtime, runtime_serial, iter,
+                   ooc_rows, ooc_steps);
+        } else if (result_correct) {
+            printf("Num bands: %d (%d threads, %d iterations per pass).\n", num_bands,
+                   num_threads, ooc_steps);
+            printf("Staging buffers: %ld requests, %ld reused, %ld allocations in %8.4f s\n",
+                   host_pool.requests, host_pool.reused, host_pool.backend_allocs,
+                   host_pool.backend_seconds);
+            if (noref) {
+                printf("%dx%d: out-of-core: %8.4f s, %d iterations, %8.2f MLUPS\n", ny, nx,
+                       runtime, iter, lups / runtime * 1.0e-6);
+            } else {
+                printf("%dx%d: 1 domain: %8.4f s, out-of-core: %8.4f s, speedup: %8.2f\n", ny,
+                       nx, runtime_serial, runtime, runtime_serial / runtime);
+            }
+        }
+        if (!trace_file.empty()) trace_dump(trace_file.c_str());
+        pool_free(&host_pool, a_h);
+        pool_free(&host_pool, a_ref_h);
+        pool_destroy(&host_pool);
+        return result_correct ? 0 : 1;
+    }
+
+    // Threads of every domain and index of its first thread in the affinity masks
+    std::vector<int> domain_threads(num_domains);
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+        domain_threads[dev_id] = int(thread_list[thread_list.size() > 1 ? dev_id : 0]);
+    std::vector<int> thread_offset(num_domains, 0);
+    const numa_topology topology = numa_discover();
+
+    // -weights splits the rows in proportion to the weights instead of evenly, calibrate weighs
+    // every domain with its speed in a short sweep of the same rows on all domains
+    if (calibrate) {
+        weights = calibrate_weights(num_domains, nx, ny, pitch, domain_threads,
+                                    numa_affinity_masks(topology, affinity_policy, domain_threads),
+                                    block_x, block_y);
+        if (!csv) {
+            printf("Calibrated weights:");
+            for (const double weight : weights) printf(" %.3f", weight / weights[0]);
+            printf("\n");
+        }
+    }
+    std::vector<int> weighted_start(num_domains + 1);
+    if (!weights.empty()) partition_weighted(weights, ny - 2, 1, weighted_start.data());
+
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        domain_state& domain = domains[dev_id];
+        // ny - 2 rows are distributed amongst `size` ranks in such a way
+        // that each rank gets either (ny - 2) / size or (ny - 2) / size + 1 rows.
+        // This optimizes load balancing when (ny - 2) % size != 0
+        int chunk_size_low = (ny - 2) / num_domains;
+        int chunk_size_high = chunk_size_low + 1;
+        // To calculate the number of ranks that need to compute an extra row,
+        // the following formula is derived from this equation:
+        // num_ranks_low * chunk_size_low + (size - num_ranks_low) * (chunk_size_low + 1) = ny - 2
+        int num_ranks_low = num_domains * chunk_size_low + num_domains -
+                            (ny - 2);  // Number of ranks with chunk_size = chunk_size_low
+        if (dev_id < num_ranks_low)
+            domain.chunk_size = chunk_size_low;
+        else
+            domain.chunk_size = chunk_size_high;
+        if (!weights.empty())
+            domain.chunk_size = weighted_start[dev_id + 1] - weighted_start[dev_id];
+
+        // -rebalance keeps spare rows before and after the domain
+        const int spare = rebalance ? domain.chunk_size / REBALANCE_SPARE_FRACTION + 1 : 0;
+        domain.capacity = domain.chunk_size + num_halo_rows + 2 * spare;
+        const size_t bytes = pitch * domain.capacity * sizeof(real);
+        domain.a = (real*)hugepage_alloc(bytes, hugepages, &hugepages_used);
+        domain.a_new = inplace ? nullptr : (real*)hugepage_alloc(bytes, hugepages, &hugepages_used);
+        if (has_source) domain.source = (real*)hugepage_alloc(bytes, hugepages, &hugepages_used);
+
+        // Calculate local domain boundaries
+        if (!weights.empty()) {
+            domain.iy_start_global = weighted_start[dev_id];
+        } else if (dev_id < num_ranks_low) {
+            domain.iy_start_global = dev_id * chunk_size_low + 1;
+        } else {
+            domain.iy_start_global =
+                num_ranks_low * chunk_size_low + (dev_id - num_ranks_low) * chunk_size_high + 1;
+        }
+
+        domain.iy_start = 1 + spare;
+        domain.iy_end = domain.iy_start + domain.chunk_size;
+    }
+
+    // Block shape and threads per domain: explicit options win, otherwise -autotune searches for
+    // the fastest configuration or a previously tuned one is taken from the tuning database. The
+    // in place sweep always works on bands of full rows, so it only tunes the threads per domain
+    // and does not share the database with the two buffer sweep.
+    if (inplace) {
+        block_x = 0;
+        block_y = 0;
+    }
+    const bool threads_set = get_arg(argv, argv + argc, "-nthreads");
+    const bool block_x_set = get_arg(argv, argv + argc, "-blockx");
+    const bool block_y_set = get_arg(argv, argv + argc, "-blocky");
+    const tune_key key = {tune_cpu_model(), nx, ny, num_domains, omp_get_num_procs()};
+    tune_config tuned;
+    if (autotune) {
+        const int min_chunk_size =
+            std::min_element(domains.begin(), domains.end(),
+                             [](const domain_state& d, const domain_state& e) {
+                                 return d.chunk_size < e.chunk_size;
+                             })->chunk_size;
+        std::vector<tune_config> candidates = tune_candidates(
+            nx, min_chunk_size, num_domains, omp_get_num_procs(), threads_set ? num_threads : 0);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&](const tune_config& c) {
+                                            return (block_x_set && c.block_x != block_x) ||
+                                                   (block_y_set && c.block_y != block_y) ||
+                                                   (inplace && (c.block_x || c.block_y));
+                                        }),
+                         candidates.end());
+        if (candidates.empty()) candidates.push_back({block_x, block_y, num_threads, 0.0});
+
+        // Trials sweep scratch copies of the domains so the solver state is untouched
+        std::vector<real*> scratch[2] = {std::vector<real*>(num_domains),
+                                         std::vector<real*>(num_domains)};
+        const int trial_iters = std::max(3, std::min(50, int(2.0e8 / (double(nx) * ny))));
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            scratch[0][dev_id] =
+                (real*)hugepage_alloc(pitch * domains[dev_id].capacity * sizeof(real), hugepages);
+            scratch[1][dev_id] =
+                (real*)hugepage_alloc(pitch * domains[dev_id].capacity * sizeof(real), hugepages);
+        }
+#pragma omp parallel num_threads(num_domains)
+        {
+            const int dev_id = omp_get_thread_num();
+            std::memset(scratch[0][dev_id], 0, pitch * domains[dev_id].capacity * sizeof(real));
+            std::memset(scratch[1][dev_id], 0, pitch * domains[dev_id].capacity * sizeof(real));
+        }
+        auto trial = [&](const tune_config& config) {
+            const std::vector<cpu_set_t> trial_affinity = numa_affinity_masks(
+                topology, affinity_policy, num_domains, config.num_threads);
+            const double trial_start = omp_get_wtime();
+#pragma omp parallel num_threads(num_domains)
+            {
+                const int dev_id = omp_get_thread_num();
+                const domain_state& domain = domains[dev_id];
+                const cpu_set_t* const team_affinity =
+                    trial_affinity.empty() ? nullptr
+                                           : &trial_affinity[dev_id * config.num_threads];
+                for (int i = 0; i < trial_iters; ++i) {
+                    if (inplace) {
+                        real* const scratch_a = scratch[0][dev_id];
+                        jacobi_kernel_inplace(scratch_a, scratch_a + (domain.iy_start - 1) * pitch,
+                                              scratch_a + domain.iy_end * pitch, domain.iy_start,
+                                              domain.iy_end, nx, pitch, config.num_threads,
+                                              team_affinity, true);
+                    } else {
+                        jacobi_kernel(scratch[(i + 1) % 2][dev_id], scratch[i % 2][dev_id],
+                                      domain.iy_start, domain.iy_end, nx, pitch,
+                                      config.num_threads, config.block_x, config.block_y,
+                                      team_affinity, true);
+                    }
+                }
+            }
+            return omp_get_wtime() - trial_start;
+        };
+
+        if (!csv)
+            printf("Autotuning %zu configurations with %d iterations each:\n", candidates.size(),
+                   trial_iters);
+        double tune_start = omp_get_wtime();
+        tuned = tune_search(candidates, trial, !csv);
+        double tune_stop = omp_get_wtime();
+        if (!inplace) tune_store(tune_db, key, tuned);
+        if (!csv)
+            printf("Autotuning took %8.4f s%s%s\n", tune_stop - tune_start,
+                   inplace ? "" : ", stored in ", inplace ? "" : tune_db.c_str());
+
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            hugepage_free(scratch[1][dev_id]);
+            hugepage_free(scratch[0][dev_id]);
+        }
+        block_x = tuned.block_x;
+        block_y = tuned.block_y;
+        num_threads = tuned.num_threads;
+    } else if (!inplace && !threads_set && !block_x_set && !block_y_set &&
+               tune_lookup(tune_db, key, &tuned)) {
+        if (!csv)
+            printf("Using tuned configuration from %s: block %d x %d, %d threads per domain\n",
+                   tune_db.c_str(), tuned.block_x, tuned.block_y, tuned.num_threads);
+        block_x = tuned.block_x;
+        block_y = tuned.block_y;
+        num_threads = tuned.num_threads;
+    }
+
+    if (!mixed_threads) domain_threads.assign(num_domains, num_threads);
+    for (int dev_id = 1; dev_id < num_domains; ++dev_id)
+        thread_offset[dev_id] = thread_offset[dev_id - 1] + domain_threads[dev_id - 1];
+    const int total_threads = thread_offset[num_domains - 1] + domain_threads[num_domains - 1];
+
+    // Pin the threads and let the thread that updates a row touch it first, so that the pages of
+    // every domain end up on the NUMA node it runs on.
+    const std::vector<cpu_set_t> affinity =
+        numa_affinity_masks(topology, affinity_policy, domain_threads);
+#pragma omp parallel num_threads(num_domains)
+    {
+        const int dev_id = omp_get_thread_num();
+        domain_state& domain = domains[dev_id];
+        const int num_threads = domain_threads[dev_id];
+        const cpu_set_t* const team_affinity =
+            affinity.empty() ? nullptr : &affinity[thread_offset[dev_id]];
+        first_touch(domain.a, domain.iy_start, domain.iy_end, nx, pitch, num_threads, block_x,
+                    block_y, team_affinity);
+        if (inplace) {
+            std::memset(domain.a + halo_top_row(dev_id, 1) * pitch, 0, 2 * pitch * sizeof(real));
+        } else {
+            first_touch(domain.a_new, domain.iy_start, domain.iy_end, nx, pitch, num_threads,
+                        block_x, block_y, team_affinity);
+        }
+
+        // Rows of the domain including its halo rows, after the spare rows of -rebalance
+        const size_t window = size_t(domain.iy_start - 1) * pitch;
+        if (init_h)
+            field_copy_interior(init_h, domain.iy_start_global - 1, domain.chunk_size + 2, nx,
+                                domain.a + window, pitch);
+        // Set the fixed boundary nodes, by default diriclet on left and right boarder
+        bc_initialize(domain.a_new ? domain.a_new + window : nullptr, domain.a + window, bc, PI,
+                      domain.iy_start_global - 1, nx, pitch, (domain.chunk_size + 2), ny);
+        if (source_h) {
+            first_touch(domain.source, domain.iy_start, domain.iy_end, nx, pitch, num_threads,
+                        block_x, block_y, team_affinity);
+            field_copy_interior(source_h, domain.iy_start_global - 1, domain.chunk_size + 2, nx,
+                                domain.source + window, pitch);
+        }
+    }
+
+    if (!csv && (topology.nodes.size() > 1 || NUMA_AFFINITY_NONE != affinity_policy)) {
+        printf("NUMA placement with %zu nodes, affinity %s:\n", topology.nodes.size(),
+               affinity_name.c_str());
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            const domain_state& domain = domains[dev_id];
+            const size_t bytes = pitch * domain.capacity * sizeof(real);
+            std::vector<long> pages, pages_new(topology.max_node_id + 1, 0);
+            long not_present, not_present_new = 0;
+            if (!numa_page_nodes(domain.a, bytes, topology.max_node_id, &pages, &not_present) ||
+                (domain.a_new && !numa_page_nodes(domain.a_new, bytes, topology.max_node_id,
+                                                  &pages_new, &not_present_new))) {
+                printf("  page placement not available (move_pages failed)\n");
+                break;
+            }
+            printf("  domain %2d pages:", dev_id);
+            for (int node = 0; node <= topology.max_node_id; ++node)
+                if (pages[node] + pages_new[node] > 0)
+                    printf(" node %d: %ld", node, pages[node] + pages_new[node]);
+            if (not_present + not_present_new > 0)
+                printf(" not present: %ld", not_present + not_present_new);
+            printf("\n");
+        }
+    }
+
+    if (!csv && HUGEPAGE_NONE != hugepages)
+        printf("Huge pages: requested %s, using %s, %ld MB of huge pages resident\n",
+               hugepage_policy_names[hugepages], hugepage_policy_names[hugepages_used],
+               hugepage_resident_kb() / 1024);
+
+    if (!csv)
+        printf(
+            "Jacobi relaxation: %d iterations on %d x %d mesh with norm check "
+            "every %d iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    int iter = 0;
+    real l2_norm = 1.0;
+
+    // -rebalance: the old and new partition and the grids of every domain after moving to it.
+    // The sweep times since the last repartition are in domain_state.
+    std::vector<int> old_start(num_domains + 1);
+    std::vector<int> new_start(num_domains + 1);
+    std::vector<real*> moved_a(num_domains);
+    std::vector<real*> moved_a_new(num_domains);
+    std::vector<real*> moved_source(num_domains);
+    std::vector<int> moved_base(num_domains);
+    std::vector<int> moved_capacity(num_domains);
+    bool repartition = false;
+    int num_repartitions = 0;
+
+    // Moves domain dev_id to the rows [new_start[dev_id], new_start[dev_id + 1]) of the new
+    // partition. The rows it did not own, halo rows included, are copied from their old owners;
+    // the grids are only reallocated, with new spare rows, if the new rows do not fit.
+    auto move_rows = [&](const int dev_id) {
+        domain_state& domain = domains[dev_id];
+        const int start = new_start[dev_id];
+        const int end = new_start[dev_id + 1];
+        const int base = domain.iy_start_global - domain.iy_start;  // Global row of local row 0
+        const bool fits = start - 1 >= base && end < base + domain.capacity;
+        moved_a[dev_id] = domain.a;
+        moved_a_new[dev_id] = domain.a_new;
+        moved_source[dev_id] = domain.source;
+        moved_base[dev_id] = base;
+        moved_capacity[dev_id] = domain.capacity;
+        if (!fits) {
+            const int spare = (end - start) / REBALANCE_SPARE_FRACTION + 1;
+            moved_capacity[dev_id] = end - start + 2 + 2 * spare;
+            moved_base[dev_id] = start - 1 - spare;
+            const size_t bytes = pitch * moved_capacity[dev_id] * sizeof(real);
+            moved_a[dev_id] = (real*)hugepage_alloc(bytes, hugepages);
+            moved_a_new[dev_id] = (real*)hugepage_alloc(bytes, hugepages);
+            if (domain.source) moved_source[dev_id] = (real*)hugepage_alloc(bytes, hugepages);
+        }
+        for (int iy = start - 1; iy <= end; ++iy) {
+            if (fits && iy >= old_start[dev_id] - 1 && iy <= old_start[dev_id + 1]) continue;
+            // Interior rows come from their old owner, the boundary rows 0 and ny - 1 stay with
+            // the first and last domain
+            const int owner = iy < 1        ? 0
+                              : iy > ny - 2 ? num_domains - 1
+                                            : partition_owner(old_start.data(), num_domains, iy);
+            const domain_state& old = domains[owner];
+            const size_t from = size_t(iy - old.iy_start_global + old.iy_start) * pitch;
+            const size_t to = size_t(iy - moved_base[dev_id]) * pitch;
+            std::memcpy(moved_a[dev_id] + to, old.a + from, pitch * sizeof(real));
+            std::memcpy(moved_a_new[dev_id] + to, old.a_new + from, pitch * sizeof(real));
+            if (old.source)
+                std::memcpy(moved_source[dev_id] + to, old.source + from, pitch * sizeof(real));
+        }
+    };
+    // Switches domain dev_id to its moved grids once all domains copied their rows
+    auto commit_rows = [&](const int dev_id) {
+        domain_state& domain = domains[dev_id];
+        if (moved_a[dev_id] != domain.a) {
+            hugepage_free(domain.source);
+            hugepage_free(domain.a_new);
+            hugepage_free(domain.a);
+        }
+        domain.a = moved_a[dev_id];
+        domain.a_new = moved_a_new[dev_id];
+        domain.source = moved_source[dev_id];
+        domain.capacity = moved_capacity[dev_id];
+        domain.iy_start_global = new_start[dev_id];
+        domain.chunk_size = new_start[dev_id + 1] - new_start[dev_id];
+        domain.iy_start = new_start[dev_id] - moved_base[dev_id];
+        domain.iy_end = domain.iy_start + domain.chunk_size;
+    };
+
+    // Norm reduction across the domains of the main solve; waits spin only if every thread has a
+    // CPU of its own
+    norm_tree norm_reduction;
+    norm_tree_init(&norm_reduction, num_domains);
+    const int spins = total_threads > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+
+    // -taskgraph runs the domains on a work stealing pool of num_domains * num_threads workers
+    task_pool graph_pool;
+    if (taskgraph) task_pool_start(&graph_pool, num_domains * num_threads, affinity);
+
+    // The reference solve, -autotune trials and -weights calibrate sweep with the same
+    // instrumented kernels; the counters report the timed solve only
+    if (perf_available) perf_reset();
+    double start = omp_get_wtime();
+    uint64_t solve_start = trace_begin();
+    PUSH_RANGE("Jacobi solve", 0)
+    if (taskgraph) {
+        iter = taskgraph_cpu(&graph_pool, domains, nx, ny, pitch, iter_max, nccheck, graph_iters,
+                             tolerance, num_threads, bc, !csv, &l2_norm);
+    } else if (p2p) {
+        iter = p2p_cpu(domains, nx, ny, pitch, iter_max, nccheck, tolerance, num_threads, block_x,
+                       block_y, affinity, bc, !csv, &l2_norm);
+    } else {
+#pragma omp parallel num_threads(num_domains)
+        {
+            const int dev_id = omp_get_thread_num();
+            domain_state& domain = domains[dev_id];
+            const int top = dev_id > 0 ? dev_id - 1 : (num_domains - 1);
+            const int bottom = (dev_id + 1) % num_domains;
+            const int num_threads = domain_threads[dev_id];
+            const cpu_set_t* const team_affinity =
+                affinity.empty() ? nullptr : &affinity[thread_offset[dev_id]];
+            uint32_t num_checks = 0;
+
+            while (l2_norm > tolerance && iter < iter_max) {
+                const bool calculate_norm = (iter % nccheck) == 0 || (!csv && (iter % 100) == 0);
+
+                uint64_t t0 = trace_begin();
+                const double compute_start = rebalance ? omp_get_wtime() : 0.0;
+                if (inplace) {
+                    domain.l2_norm = jacobi_kernel_inplace(
+                        domain.a, domain.a + halo_top_row(dev_id, iter % 2) * pitch,
+                        domain.a + halo_bottom_row(dev_id, iter % 2) * pitch, domain.iy_start,
+                        domain.iy_end, nx, pitch, num_threads, team_affinity, calculate_norm);
+                } else {
+                    domain.l2_norm = jacobi_kernel(domain.a_new, domain.a, domain.iy_start,
+                                                   domain.iy_end, nx, pitch, num_threads, block_x,
+                                                   block_y, team_affinity, calculate_norm,
+                                                   domain.source);
+                    // Neumann, Robin and periodic boundary nodes, nothing to do by default
+                    bc_apply_columns(domain.a_new, bc, domain.iy_start, domain.iy_end, nx, pitch);
+                    if (0 == dev_id)
+                        bc_apply_row(domain.a_new + (domain.iy_start - 1) * pitch,
+                                     domain.a_new + domain.iy_start * pitch, bc.top, nx, ny);
+                    if (num_domains - 1 == dev_id)
+                        bc_apply_row(domain.a_new + domain.iy_end * pitch,
+                                     domain.a_new + (domain.iy_end - 1) * pitch, bc.bottom, nx, ny);
+                }
+                if (rebalance) domain.compute_seconds += omp_get_wtime() - compute_start;
+                trace_end("compute", t0, iter, dev_id);
+
+                // Apply periodic boundary conditions
+                t0 = trace_begin();
+                const perf_values p0 = perf_begin();
+                if (inplace) {
+                    const int slot = (iter + 1) % 2;
+                    std::memcpy(domains[top].a + halo_bottom_row(top, slot) * pitch,
+                                domain.a + domain.iy_start * pitch, nx * sizeof(real));
+                    std::memcpy(domains[bottom].a + halo_top_row(bottom, slot) * pitch,
+                                domain.a + (domain.iy_end - 1) * pitch, nx * sizeof(real));
+                } else {
+                    // Without periodic top and bottom edges the first and last domain keep their
+                    // boundary rows instead of wrapping around
+                    if (periodic_y || dev_id > 0)
+                        std::memcpy(domains[top].a_new + (domains[top].iy_end * pitch),
+                                    domain.a_new + domain.iy_start * pitch, nx * sizeof(real));
+                    if (periodic_y || dev_id < num_domains - 1)
+                        std::memcpy(domains[bottom].a_new + (domains[bottom].iy_start - 1) * pitch,
+                                    domain.a_new + (domain.iy_end - 1) * pitch, nx * sizeof(real));
+                }
+                perf_end(PERF_PHASE_HALO, p0);
+                trace_end("halo_push", t0, iter, dev_id);
+
+                // Sum the norms of all domains along the tree of jacobi_reduce.h, which hands
+                // the sum to every domain
+                real l2_norm_sq = 0.0;
+                if (calculate_norm) {
+                    t0 = trace_begin();
+                    const perf_values p1 = perf_begin();
+                    l2_norm_sq = norm_tree_reduce(&norm_reduction, dev_id, ++num_checks,
+                                                  domain.l2_norm, spins);
+                    perf_end(PERF_PHASE_REDUCTION, p1);
+                    trace_end("norm_reduction", t0, iter, dev_id);
+                }
+
+                t0 = trace_begin();
+#pragma omp barrier
+                trace_end("host_wait", t0, iter, dev_id);
+
+#pragma omp single
+                {
+                    if (calculate_norm) {
+                        l2_norm = std::sqrt(l2_norm_sq);
+                        if (!csv && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+                    }
+
+                    for (int dev_id = 0; !inplace && dev_id < num_domains; ++dev_id) {
+                        std::swap(domains[dev_id].a_new, domains[dev_id].a);
+                    }
+                    iter++;
+                }
+
+                // -rebalance: repartition the rows in proportion to the measured speed of the
+                // domains, all of them wait for the rows to move
+                if (rebalance && (iter % rebalance) == 0 && l2_norm > tolerance &&
+                    iter < iter_max) {
+                    t0 = trace_begin();
+#pragma omp single
+                    {
+                        std::vector<int> chunk_size(num_domains);
+                        std::vector<double> compute_seconds(num_domains);
+                        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+                            old_start[dev_id] = domains[dev_id].iy_start_global;
+                            chunk_size[dev_id] = domains[dev_id].chunk_size;
+                            compute_seconds[dev_id] = domains[dev_id].compute_seconds;
+                        }
+                        old_start[num_domains] = ny - 1;
+                        repartition = partition_rebalance(chunk_size.data(), compute_seconds.data(),
+                                                          num_domains, ny - 2, REBALANCE_MIN_GAIN,
+                                                          new_start.data());
+                        if (repartition) num_repartitions++;
+                    }
+                    domain.compute_seconds = 0.0;
+                    if (repartition) {
+                        move_rows(dev_id);
+#pragma omp barrier
+                        commit_rows(dev_id);
+#pragma omp barrier
+                    }
+                    trace_end("rebalance", t0, iter, dev_id);
+                }
+            }
+        }
+    }
+    POP_RANGE
+    trace_end("jacobi_solve", solve_start, -1, -1);
+    double stop = omp_get_wtime();
+    if (taskgraph) task_pool_stop(&graph_pool);
+
+    // Gather the pitched domains into the dense result
+    int offset = nx;
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        const domain_state& domain = domains[dev_id];
+        for (int iy = domain.iy_start; iy < domain.iy_end && offset < nx * ny; ++iy) {
+            std::memcpy(a_h + offset, domain.a + iy * pitch, nx * sizeof(real));
+            offset += nx;
+        }
+    }
+
+    if (!save_file.empty()) {
+        if (periodic_y) {
+            field_periodic_halos(a_h, nx, ny);
+        } else {
+            const domain_state& first = domains.front();
+            const domain_state& last = domains.back();
+            std::memcpy(a_h, first.a + (first.iy_start - 1) * pitch, nx * sizeof(real));
+            std::memcpy(a_h + (ny - 1) * nx, last.a + last.iy_end * pitch, nx * sizeof(real));
+        }
+        if (!field_save(save_file, a_h, nx, ny)) return -1;
+    }
+
+    // -noref skips the single domain reference run and with it the verification
+    const bool result_correct = noref || check_result(a_ref_h, a_h, nx, ny);
+
+    // Attained rates of the solve under the roofline model of a lattice update
+    const double lups = double(nx - 2) * double(ny - 2) * iter;
+    const double attained_gbs = lups * bytes_per_lup / (stop - start) * 1.0e-9;
+    const double attained_gflops = lups * flops_per_lup / (stop - start) * 1.0e-9;
+
+    if (result_correct) {
+        if (csv) {
+            printf("openmp_cpu, %d, %d, %d, %d, %d, %d, %f, %f, %d, %d, %d", nx, ny, iter_max,
+                   nccheck, num_domains, num_threads, (stop - start), runtime_serial, iter,
+                   block_x, block_y);
+            if (perf) {
+                // attained GB/s and GFLOP/s, measured DRAM GB/s, then cycles, instructions and
+                // LLC misses of every phase (0 if counters are unavailable)
+                printf(", %f, %f, %f", attained_gbs, attained_gflops,
+                       perf_available ? (perf_dram_bytes(PERF_PHASE_STENCIL) +
+                                         perf_dram_bytes(PERF_PHASE_HALO) +
+                                         perf_dram_bytes(PERF_PHASE_REDUCTION)) /
+                                            (stop - start) * 1.0e-9
+                                      : 0.0);
+                for (int phase = 0; phase < PERF_NUM_PHASES; ++phase) {
+                    const perf_phase p = perf_phase(phase);
+                    printf(", %llu, %llu, %llu", (unsigned long long)perf_total(p, PERF_CYCLES),
+                           (unsigned long long)perf_total(p, PERF_INSTRUCTIONS),
+                           (unsigned long long)(perf_total(p, PERF_LLC_READ_MISSES) +
+                                                perf_total(p, PERF_LLC_WRITE_MISSES)));
+                }
+            }
+            printf("\n");
+        } else {
+            std::string threads_desc = std::to_string(num_threads) + " threads each";
+            if (mixed_threads) {
+                threads_desc = "threads";
+                for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+                    threads_desc += (dev_id ? ", " : " ") + std::to_string(domain_threads[dev_id]);
+            }
+            printf("Num domains: %d (%s%s).\n", num_domains, threads_desc.c_str(),
+                   inplace       ? ", in place"
+                   : graph_iters ? ", task graph replay"
+                   : taskgraph   ? ", task graph"
+                   : p2p         ? ", point to point"
+                                 : "");
+            if (rebalance || !weights.empty()) {
+                if (rebalance) printf("Rebalanced %d times, ", num_repartitions);
+                printf("%s per domain:", rebalance ? "rows" : "Rows");
+                for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+                    printf(" %d", domains[dev_id].chunk_size);
+                printf("\n");
+            }
+            printf("Staging buffers: %ld requests, %ld reused, %ld allocations in %8.4f s\n",
+                   host_pool.requests, host_pool.reused, host_pool.backend_allocs,
+                   host_pool.backend_seconds);
+            if (noref) {
+                printf("%dx%d: %d domains: %8.4f s, %d iterations, %8.2f MLUPS\n", ny, nx,
+                       num_domains, (stop - start), iter, lups / (stop - start) * 1.0e-6);
+            } else {
+                printf(
+                    "%dx%d: 1 domain: %8.4f s, %d domains: %8.4f s, speedup: %8.2f, "
+                    "efficiency: %8.2f \n",
+                    ny, nx, runtime_serial, num_domains, (stop - start),
+                    runtime_serial / (stop - start),
+                    runtime_serial / (num_domains * (stop - start)) * 100);
+            }
+            if (perf) {
+                printf("Attained: %8.2f GB/s, %8.2f GFLOP/s (%d B and %d FLOP per update)\n",
+                       attained_gbs, attained_gflops, bytes_per_lup, flops_per_lup);
+            }
+            if (perf_available) {
+                printf("%-10s %16s %16s %6s %14s %10s %10s\n", "phase", "cycles", "instructions",
+                       "IPC", "LLC misses", "DRAM GB/s", "B/update");
+                for (int phase = 0; phase < PERF_NUM_PHASES; ++phase) {
+                    const perf_phase p = perf_phase(phase);
+                    const uint64_t cycles = perf_total(p, PERF_CYCLES);
+                    const uint64_t instructions = perf_total(p, PERF_INSTRUCTIONS);
+                    const uint64_t dram_bytes = perf_dram_bytes(p);
+                    // phase time summed over threads, averaged over the concurrently running ones
+                    const double seconds =
+                        perf_total_ns(p) * 1.0e-9 /
+                        (phase == PERF_PHASE_STENCIL ? total_threads : num_domains);
+                    printf("%-10s %16llu %16llu %6.2f %14llu %10.2f %10.2f\n",
+                           perf_phase_names[phase], (unsigned long long)cycles,
+                           (unsigned long long)instructions,
+                           cycles > 0 ? double(instructions) / cycles : 0.0,
+                           (unsigned long long)(dram_bytes / PERF_CACHE_LINE_BYTES),
+                           seconds > 0 ? dram_bytes / seconds * 1.0e-9 : 0.0,
+                           phase == PERF_PHASE_STENCIL && lups > 0 ? dram_bytes / lups : 0.0);
+                }
+            }
+        }
+    }
+
+    if (!trace_file.empty()) trace_dump(trace_file.c_str());
+
+    for (int dev_id = (num_domains - 1); dev_id >= 0; --dev_id) {
+        domain_state& domain = domains[dev_id];
+        hugepage_free(domain.source);
+        hugepage_free(domain.a_new);
+        hugepage_free(domain.a);
+    }
+    pool_free(&host_pool, a_h);
+    pool_free(&host_pool, a_ref_h);
+    pool_destroy(&host_pool);
+
+    return result_correct ? 0 : 1;
+}
+
+double single_cpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real tolerance,
+                  const real* const init, const boundary_conditions& bc,
+                  const real* const source) {
+    real* a;
+    real* a_new;
+    real* source_pitched = nullptr;
+
+    int iy_start = 1;
+    int iy_end = (ny - 1);
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    a = (real*)pool_alloc(&host_pool, pitch * ny * sizeof(real));
+    a_new = (real*)pool_alloc(&host_pool, pitch * ny * sizeof(real));
+
+    std::memset(a, 0, pitch * ny * sizeof(real));
+    std::memset(a_new, 0, pitch * ny * sizeof(real));
+
+    if (init) field_copy_interior(init, 0, ny, nx, a, pitch);
+    // Set the fixed boundary nodes, by default diriclet on left and right boarder
+    bc_initialize(a, a_new, bc, PI, 0, nx, pitch, ny, ny);
+    if (source) {
+        source_pitched = (real*)pool_alloc(&host_pool, pitch * ny * sizeof(real));
+        std::memset(source_pitched, 0, pitch * ny * sizeof(real));
+        field_copy_interior(source, 0, ny, nx, source_pitched, pitch);
+    }
+
+    if (print)
+        printf(
+            "Single domain jacobi relaxation: %d iterations on %d x %d mesh with "
+            "norm "
+            "check every %d iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    int iter = 0;
+    bool calculate_norm;
+    real l2_norm = 1.0;
+
+    double start = omp_get_wtime();
+    PUSH_RANGE("Jacobi solve", 0)
+    while (l2_norm > tolerance && iter < iter_max) {
+        calculate_norm = (iter % nccheck) == 0 || (print && ((iter % 100) == 0));
+        const real l2_norm_sq = jacobi_kernel(a_new, a, iy_start, iy_end, nx, pitch, 1, 0, 0,
+                                              nullptr, calculate_norm, source_pitched);
+        bc_apply_columns(a_new, bc, iy_start, iy_end, nx, pitch);
+
+        // Apply periodic boundary conditions
+        if (BC_PERIODIC == bc.top.type) {
+            std::memcpy(a_new, a_new + (iy_end - 1) * pitch, nx * sizeof(real));
+            std::memcpy(a_new + iy_end * pitch, a_new + iy_start * pitch, nx * sizeof(real));
+        } else {
+            bc_apply_row(a_new, a_new + iy_start * pitch, bc.top, nx, ny);
+            bc_apply_row(a_new + iy_end * pitch, a_new + (iy_end - 1) * pitch, bc.bottom, nx, ny);
+        }
+
+        if (calculate_norm) {
+            l2_norm = std::sqrt(l2_norm_sq);
+            if (print && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        std::swap(a_new, a);
+        iter++;
+    }
+    POP_RANGE
+    double stop = omp_get_wtime();
+
+    for (int iy = 0; iy < ny; ++iy)
+        std::memcpy(a_ref_h + iy * nx, a + iy * pitch, nx * sizeof(real));
+
+    if (source_pitched) pool_free(&host_pool, source_pitched);
+    pool_free(&host_pool, a_new);
+    pool_free(&host_pool, a);
+    return (stop - start);
+}
+
+// Out-of-core solve of -ooc: the grid lives in file (ny rows of pitch elements) and is streamed
+// through memory in bands of about band_rows rows, decomposed like the domains with chunk_size.
+// Every pass over the file applies up to num_steps iterations (temporal blocking): a band is
+// loaded with num_steps ghost rows on each side, which shrink by one row per step, so one read and
+// one write of every row are amortised over num_steps iterations. The ghost rows shared with the
+// next band are carried over in memory, the rows wrapping around the periodic boundary are saved
+// at the start of the pass, and the I/O thread prefetches the next band and writes back the
+// previous one while a band is computed. The arithmetic is that of the in memory solve, but the
+// norm is only checked at the end of a pass, so a converged solve may run up to num_steps - 1
+// iterations further. If a_h is not null the result is copied into it (dense, nx elements per row).
+// Returns the runtime of the solve or a negative value if the file cannot be accessed.
+double ooc_cpu(const std::string& file, const int nx, const int ny, const int iter_max,
+               const int nccheck, const int band_rows, const int num_steps, const int num_threads,
+               const int block_x, const int block_y, real* const a_h, const bool print,
+               const real tolerance, int* const iterations, int* const bands) {
+    const int pitch = row_pitch(nx, sizeof(real));
+    const size_t row_bytes = pitch * sizeof(real);
+    const int num_rows = ny - 2;  // Interior rows, row y of the interior is row y + 1 of the file
+
+    // Same decomposition as the domains: every band gets chunk_size_low or chunk_size_low + 1 rows
+    const int num_bands = std::min(num_rows, (num_rows + band_rows - 1) / band_rows);
+    const int chunk_size_low = num_rows / num_bands;
+    const int num_ranks_low = num_bands * chunk_size_low + num_bands - num_rows;
+    std::vector<int> band_start(num_bands + 1);
+    for (int b = 0; b <= num_bands; ++b)
+        band_start[b] = b * chunk_size_low + std::max(0, b - num_ranks_low);
+    const int max_band_rows = chunk_size_low + (num_ranks_low < num_bands ? 1 : 0);
+    *bands = num_bands;
+
+    const int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: cannot open %s: %s\n", file.c_str(), strerror(errno));
+        return -1.0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    auto file_offset = [&](const int file_row) { return off_t(file_row) * row_bytes; };
+
+    // Two band buffer sets (the band being computed and the one being loaded), each with the two
+    // grids of the sweep, and the rows wrapping around the periodic boundary
+    const int buf_rows = std::max(max_band_rows + 2 * num_steps, 2);
+    real* buf[2][2];
+    for (int set = 0; set < 2; ++set)
+        for (int g = 0; g < 2; ++g)
+            buf[set][g] = (real*)pool_alloc(&host_pool, buf_rows * row_bytes);
+    real* wrap_top = (real*)pool_alloc(&host_pool, num_steps * row_bytes);
+    real* wrap_bottom = (real*)pool_alloc(&host_pool, num_steps * row_bytes);
+
+    // Initial grid: zero with Dirichlet boundary conditions on left and right border
+    bool ok = true;
+    for (int row = 0; ok && row < ny; row += buf_rows) {
+        const int rows = std::min(buf_rows, ny - row);
+        std::memset(buf[0][0], 0, rows * row_bytes);
+        initialize_boundaries(nullptr, buf[0][0], PI, row, nx, pitch, rows, ny);
+        ok = ooc_pwrite(fd, buf[0][0], rows * row_bytes, file_offset(row));
+    }
+
+    // Reads interior rows [first, first + count) at the state of the start of the pass, taking the
+    // rows beyond the periodic boundary (first < 0 or first + count > num_rows) from the saved ones
+    auto read_rows = [&](real* dst, const int first, const int count, const int halo) {
+        const int last = first + count;
+        const int top = std::min(std::max(-first, 0), count);
+        const int bottom = std::min(std::max(last - num_rows, 0), count);
+        if (top > 0) std::memcpy(dst, wrap_bottom + (halo - top) * pitch, top * row_bytes);
+        if (bottom > 0)
+            std::memcpy(dst + (count - bottom) * pitch,
+                        wrap_top + (last - bottom - num_rows) * pitch, bottom * row_bytes);
+        const int inner = count - top - bottom;
+        return inner <= 0 || ooc_pread(fd, dst + top * pitch, inner * row_bytes,
+                                       file_offset(first + top + 1));
+    };
+
+    ooc_io io;
+    ooc_io_start(&io);
+
+    if (print)
+        printf(
+            "Out-of-core jacobi relaxation: %d iterations on %d x %d mesh in %s with %d bands of "
+            "up to %d rows, %d iterations per pass\n",
+            iter_max, ny, nx, file.c_str(), num_bands, max_band_rows, num_steps);
+
+    int iter = 0;
+    real l2_norm = 1.0;
+    std::vector<real> l2_norm_sq(num_steps);
+    std::vector<char> calculate_norm(num_steps);
+
+    double start = omp_get_wtime();
+    PUSH_RANGE("Jacobi solve", 0)
+    while (ok && l2_norm > tolerance && iter < iter_max) {
+        const int steps = std::min(num_steps, iter_max - iter);
+        for (int s = 0; s < steps; ++s) {
+            calculate_norm[s] =
+                ((iter + s) % nccheck) == 0 || (print && ((iter + s) % 100) == 0);
+            l2_norm_sq[s] = 0.0;
+        }
+
+        uint64_t t0 = trace_begin();
+        ok = ooc_pread(fd, wrap_top, steps * row_bytes, file_offset(1)) &&
+             ooc_pread(fd, wrap_bottom, steps * row_bytes, file_offset(num_rows - steps + 1)) &&
+             read_rows(buf[0][0], -steps, band_start[1] - band_start[0] + 2 * steps, steps);
+        trace_end("io_wait", t0, iter, -1);
+
+        uint64_t write_ticket[2] = {0, 0};
+        for (int b = 0; ok && b < num_bands; ++b) {
+            const int cur = b % 2;
+            const int nxt = 1 - cur;
+            const int rows = band_start[b + 1] - band_start[b] + 2 * steps;
+
+            // Carry the ghost rows shared with the next band over and prefetch the rest of it
+            uint64_t read_ticket = 0;
+            if (b + 1 < num_bands) {
+                t0 = trace_begin();
+                ok = ooc_io_wait(&io, write_ticket[nxt]);
+                trace_end("io_wait", t0, iter, b);
+                std::memcpy(buf[nxt][0], buf[cur][0] + (rows - 2 * steps) * pitch,
+                            2 * steps * row_bytes);
+                real* const dst = buf[nxt][0] + 2 * steps * pitch;
+                const int first = band_start[b + 1] + steps;
+                const int count = band_start[b + 2] - band_start[b + 1];
+                read_ticket = ooc_io_submit(&io, [&read_rows, dst, first, count, steps] {
+                    return read_rows(dst, first, count, steps);
+                });
+            }
+
+            t0 = trace_begin();
+            real* a = buf[cur][0];
+            real* a_new = buf[cur][1];
+            for (int iy = 0; iy < rows; ++iy) {
+                a_new[iy * pitch + 0] = a[iy * pitch + 0];
+                a_new[iy * pitch + (nx - 1)] = a[iy * pitch + (nx - 1)];
+            }
+            // Step s updates local rows [s, rows - s), the band owns [steps, rows - steps)
+            for (int s = 1; s <= steps; ++s) {
+                if (s < steps) {
+                    jacobi_kernel(a_new, a, s, steps, nx, pitch, num_threads, block_x, block_y,
+                                  nullptr, false);
+                    jacobi_kernel(a_new, a, rows - steps, rows - s, nx, pitch, num_threads,
+                                  block_x, block_y, nullptr, false);
+                }
+                l2_norm_sq[s - 1] +=
+                    jacobi_kernel(a_new, a, steps, rows - steps, nx, pitch, num_threads, block_x,
+                                  block_y, nullptr, calculate_norm[s - 1]);
+                std::swap(a_new, a);
+            }
+            trace_end("compute", t0, iter, b);
+
+            const int owned = rows - 2 * steps;
+            const off_t offset = file_offset(band_start[b] + 1);
+            real* const src = a + steps * pitch;
+            write_ticket[cur] = ooc_io_submit(&io, [fd, src, owned, row_bytes, offset] {
+                return ooc_pwrite(fd, src, owned * row_bytes, offset);
+            });
+
+            t0 = trace_begin();
+            if (read_ticket) ok = ooc_io_wait(&io, read_ticket) && ok;
+            trace_end("io_wait", t0, iter, b);
+        }
+        ok = ooc_io_wait(&io, io.submitted) && ok;
+
+        for (int s = 0; s < steps && l2_norm > tolerance; ++s) {
+            if (calculate_norm[s]) {
+                l2_norm = std::sqrt(l2_norm_sq[s]);
+                if (print && ((iter + s) % 100) == 0) printf("%5d, %0.6f\n", iter + s, l2_norm);
+            }
+        }
+        iter += steps;
+    }
+    POP_RANGE
+    double stop = omp_get_wtime();
+
+    // Leave a complete grid in the file: the halo rows are the periodic images of the interior
+    ok = ok && ooc_pread(fd, wrap_top, row_bytes, file_offset(1)) &&
+         ooc_pread(fd, wrap_bottom, row_bytes, file_offset(num_rows)) &&
+         ooc_pwrite(fd, wrap_bottom, row_bytes, file_offset(0)) &&
+         ooc_pwrite(fd, wrap_top, row_bytes, file_offset(ny - 1));
+
+    for (int iy = 0; ok && a_h && iy < ny; ++iy) {
+        ok = ooc_pread(fd, buf[0][0], row_bytes, file_offset(iy));
+        std::memcpy(a_h + iy * nx, buf[0][0], nx * sizeof(real));
+    }
+
+    ooc_io_stop(&io);
+    close(fd);
+    pool_free(&host_pool, wrap_bottom);
+    pool_free(&host_pool, wrap_top);
+    for (int set = 1; set >= 0; --set)
+        for (int g = 1; g >= 0; --g) pool_free(&host_pool, buf[set][g]);
+    *iterations = iter;
+    return ok ? (stop - start) : -1.0;
+}
+
+// Calibration of -weights calibrate: every domain sweeps a scratch grid of the same rows with
+// its own threads, all domains at once so that they compete for memory bandwidth like in the
+// solve. Returns the speed of every domain in rows per second.
+std::vector<double> calibrate_weights(const int num_domains, const int nx, const int ny,
+                                      const int pitch, const std::vector<int>& domain_threads,
+                                      const std::vector<cpu_set_t>& affinity, const int block_x,
+                                      const int block_y) {
+    const int rows = std::max(1, (ny - 2) / num_domains);
+    const int trial_iters = std::max(3, std::min(50, int(2.0e8 / (double(nx) * ny))));
+    std::vector<double> speed(num_domains);
+#pragma omp parallel num_threads(num_domains)
+    {
+        const int dev_id = omp_get_thread_num();
+        const int num_threads = domain_threads[dev_id];
+        int first_thread = 0;
+        for (int d = 0; d < dev_id; ++d) first_thread += domain_threads[d];
+        const cpu_set_t* const team_affinity = affinity.empty() ? nullptr : &affinity[first_thread];
+        real* scratch[2];
+        for (real*& grid : scratch) {
+            grid = (real*)hugepage_alloc(pitch * (rows + 2) * sizeof(real), HUGEPAGE_NONE);
+            first_touch(grid, 1, rows + 1, nx, pitch, num_threads, block_x, block_y,
+                        team_affinity);
+        }
+#pragma omp barrier
+        const double start = omp_get_wtime();
+        for (int i = 0; i < trial_iters; ++i)
+            jacobi_kernel(scratch[(i + 1) % 2], scratch[i % 2], 1, rows + 1, nx, pitch,
+                          num_threads, block_x, block_y, team_affinity, true);
+        speed[dev_id] = double(rows) * trial_iters / (omp_get_wtime() - start);
+        for (real* grid : scratch) hugepage_free(grid);
+    }
+    return speed;
+}
+
+// Solve of -taskgraph: the iteration of the multi-GPU drivers expressed with the streams and events
+// of jacobi_taskgraph.h. Every domain has a compute stream and two push streams; the sweep of a
+// domain is launched in parts of full rows that the workers of pool share by work stealing, it
+// waits for the halo pushes of its neighbours and the pushes wait for its sweep. The host only
+// waits on iterations that check the norm, all other iterations are queued without any barrier.
+// a and a_new are swapped like in the main solve. Returns the number of iterations.
+int taskgraph_cpu(task_pool* pool, std::vector<domain_state>& domains, const int nx, const int ny,
+                  const int pitch, const int iter_max, const int nccheck, const int graph_iters,
+                  const real tolerance, const int num_threads, const boundary_conditions& bc,
+                  const bool print, real* const l2_norm_out) {
+    const int num_domains = int(domains.size());
+    const bool periodic_y = BC_PERIODIC == bc.top.type;
+    const int max_parts = TASKGRAPH_PARTS_PER_THREAD * num_threads;
+    std::vector<host_stream> compute_stream(num_domains);
+    std::vector<host_stream> push_top_stream(num_domains);
+    std::vector<host_stream> push_bottom_stream(num_domains);
+    std::vector<host_event> compute_done(num_domains);
+    // The pushes of iteration iter record into slot (iter + 1) % 2 and the sweeps of iter wait for
+    // slot iter % 2, like the events of the GPU drivers. With one slot, domain d would wait for
+    // the push domain d - 1 just recorded for the same iteration, and the domains would sweep one
+    // after another.
+    std::vector<host_event> push_top_done[2] = {std::vector<host_event>(num_domains),
+                                                std::vector<host_event>(num_domains)};
+    std::vector<host_event> push_bottom_done[2] = {std::vector<host_event>(num_domains),
+                                                   std::vector<host_event>(num_domains)};
+    // Norm of every part, summed in a fixed order by the host. Parts of a domain run on different
+    // workers, so every norm has a cache line of its own.
+    std::vector<padded<real>> l2_norm_parts(num_domains * max_parts);
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        compute_stream[dev_id].pool = pool;
+        push_top_stream[dev_id].pool = pool;
+        push_bottom_stream[dev_id].pool = pool;
+    }
+
+    // Events of the pushes that write the top and bottom halo of domain dev_id into slot: the
+    // pushes of its neighbours, or without periodic boundaries the boundary rows that the first
+    // and last domain write themselves
+    auto top_halo_done = [&](const int slot, const int dev_id) -> host_event& {
+        if (!periodic_y && 0 == dev_id) return push_top_done[slot][dev_id];
+        return push_bottom_done[slot][dev_id > 0 ? dev_id - 1 : (num_domains - 1)];
+    };
+    auto bottom_halo_done = [&](const int slot, const int dev_id) -> host_event& {
+        if (!periodic_y && num_domains - 1 == dev_id) return push_bottom_done[slot][dev_id];
+        return push_top_done[slot][(dev_id + 1) % num_domains];
+    };
+
+    // Launches the operations of iteration iter, from a into a_new
+    auto launch_iteration = [&](const int iter, const bool calculate_norm) {
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            const int top = dev_id > 0 ? dev_id - 1 : (num_domains - 1);
+            const int bottom = (dev_id + 1) % num_domains;
+            const domain_state& domain = domains[dev_id];
+            const int chunk = domain.iy_end - domain.iy_start;
+            const int num_parts = std::min(max_parts, chunk);
+            const int band = (chunk + num_parts - 1) / num_parts;
+            real* const dst = domain.a_new;
+            const real* const src = domain.a;
+            const real* const dev_source = domain.source;
+            const int y_start = domain.iy_start;
+            const int y_end = domain.iy_end;
+            padded<real>* const part_norms = l2_norm_parts.data() + dev_id * max_parts;
+
+            // Wait for the halos of this iteration
+            stream_wait_event(&compute_stream[dev_id], &top_halo_done(iter % 2, dev_id));
+            stream_wait_event(&compute_stream[dev_id], &bottom_halo_done(iter % 2, dev_id));
+            stream_launch(&compute_stream[dev_id], num_parts, [=, &bc](const int part) {
+                const uint64_t t0 = trace_begin();
+                const int y0 = std::min(y_start + part * band, y_end);
+                const int y1 = std::min(y0 + band, y_end);
+                real part_norm = 0.0;
+                for (int iy = y0; iy < y1; ++iy) {
+                    part_norm +=
+                        dev_source ? jacobi_row<true>(dst, src, dev_source, iy, 1, nx - 1, pitch)
+                                   : jacobi_row<false>(dst, src, dev_source, iy, 1, nx - 1, pitch);
+                }
+                bc_apply_columns(dst, bc, y0, y1, nx, pitch);
+                if (calculate_norm) part_norms[part].value = part_norm;
+                trace_end("compute", t0, iter, dev_id);
+            });
+            event_record(&compute_done[dev_id], &compute_stream[dev_id]);
+
+            // Apply periodic boundary conditions, or the top and bottom boundary kernels at the
+            // first and last domain
+            real* const dst_top = domains[top].a_new + domains[top].iy_end * pitch;
+            real* const dst_bottom = domains[bottom].a_new + (domains[bottom].iy_start - 1) * pitch;
+            const bool push_top = periodic_y || dev_id > 0;
+            const bool push_bottom = periodic_y || dev_id < num_domains - 1;
+            stream_wait_event(&push_top_stream[dev_id], &compute_done[dev_id]);
+            stream_launch(&push_top_stream[dev_id], 1, [=, &bc](int) {
+                if (push_top)
+                    std::memcpy(dst_top, dst + y_start * pitch, nx * sizeof(real));
+                else
+                    bc_apply_row(dst, dst + y_start * pitch, bc.top, nx, ny);
+            });
+            event_record(&push_top_done[(iter + 1) % 2][dev_id], &push_top_stream[dev_id]);
+            stream_wait_event(&push_bottom_stream[dev_id], &compute_done[dev_id]);
+            stream_launch(&push_bottom_stream[dev_id], 1, [=, &bc](int) {
+                if (push_bottom)
+                    std::memcpy(dst_bottom, dst + (y_end - 1) * pitch, nx * sizeof(real));
+                else
+                    bc_apply_row(dst + y_end * pitch, dst + (y_end - 1) * pitch, bc.bottom, nx,
+                                 ny);
+            });
+            event_record(&push_bottom_done[(iter + 1) % 2][dev_id], &push_bottom_stream[dev_id]);
+        }
+
+    };
+    auto sum_norm = [&l2_norm_parts]() {
+        real l2_norm = 0.0;
+        for (const padded<real>& part_norm : l2_norm_parts) l2_norm += part_norm.value;
+        return std::sqrt(l2_norm);
+    };
+    std::vector<host_stream*> streams;
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        streams.push_back(&compute_stream[dev_id]);
+        streams.push_back(&push_top_stream[dev_id]);
+        streams.push_back(&push_bottom_stream[dev_id]);
+    }
+    auto reset_events = [&]() {
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            compute_done[dev_id].node.reset();
+            for (int slot = 0; slot < 2; ++slot) {
+                push_top_done[slot][dev_id].node.reset();
+                push_bottom_done[slot][dev_id].node.reset();
+            }
+        }
+    };
+
+#ifdef JACOBI_DEBUG
+    // Debug builds check the events: capture two iterations, every push of the first has to
+    // come before the sweep of the second on the domain it writes to (its neighbour, or itself
+    // at a non-periodic edge), and no sweep may depend on the sweep of another domain of the
+    // same iteration, or the domains would not run side by side.
+    {
+        task_graph check;
+        std::vector<task_node_ptr> sweeps(2 * num_domains);
+        task_graph_begin(&check, streams);
+        for (int i = 0; i < 2; ++i) {
+            launch_iteration(i, false);
+            for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+                sweeps[i * num_domains + dev_id] = compute_done[dev_id].node;
+        }
+        task_graph_end(&check, streams);
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            const int top = periodic_y || dev_id > 0 ? (dev_id + num_domains - 1) % num_domains
+                                                     : dev_id;
+            const int bottom =
+                periodic_y || dev_id < num_domains - 1 ? (dev_id + 1) % num_domains : dev_id;
+            assert(task_graph_reaches(push_top_done[1][dev_id].node, sweeps[num_domains + top]));
+            assert(task_graph_reaches(push_bottom_done[1][dev_id].node,
+                                      sweeps[num_domains + bottom]));
+            for (int other = 0; other < num_domains; ++other) {
+                for (int i = 0; i < 2; ++i)
+                    assert(other == dev_id ||
+                           !task_graph_reaches(sweeps[i * num_domains + dev_id],
+                                               sweeps[i * num_domains + other]));
+            }
+        }
+        reset_events();
+    }
+#endif
+
+    int iter = 0;
+    real l2_norm = 1.0;
+
+    // Launches iteration iter and, if it checks the norm, waits for it
+    auto step = [&]() {
+        const bool calculate_norm = (iter % nccheck) == 0 || (print && (iter % 100) == 0);
+        launch_iteration(iter, calculate_norm);
+
+        if (calculate_norm) {
+            const uint64_t t0 = trace_begin();
+            for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+                event_synchronize(&compute_done[dev_id]);
+            trace_end("host_wait", t0, iter, -1);
+            l2_norm = sum_norm();
+            if (print && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        for (domain_state& domain : domains) std::swap(domain.a_new, domain.a);
+        iter++;
+    };
+
+    if (graph_iters > 0 && graph_iters < iter_max) {
+        // -graph: capture graph_iters iterations once and replay them. Iteration 0 runs on its
+        // own, so that the last iteration of a replay, the only one that checks the norm, is a
+        // multiple of graph_iters like the checks of -nccheck and the solve stops where the
+        // reference does. An odd count ends with a and a_new swapped, a second graph starts there.
+        step();
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            stream_synchronize(&push_top_stream[dev_id]);
+            stream_synchronize(&push_bottom_stream[dev_id]);
+        }
+        const int num_graphs = graph_iters % 2 ? 2 : 1;
+        task_graph graphs[2];
+        for (int g = 0; g < num_graphs; ++g) {
+            // A replay starts after the previous one completed, the events of its last iteration
+            // are no dependencies of the first
+            reset_events();
+            task_graph_begin(&graphs[g], streams);
+            for (int i = 0; i < graph_iters; ++i) {
+                launch_iteration(iter + i, graph_iters - 1 == i);
+                for (domain_state& domain : domains) std::swap(domain.a_new, domain.a);
+            }
+            task_graph_end(&graphs[g], streams);
+        }
+        // The captures swapped the grids an even number of times, back to those of the first graph
+        reset_events();
+
+        int g = 0;
+        while (l2_norm > tolerance && iter + graph_iters <= iter_max) {
+            const uint64_t t0 = trace_begin();
+            task_graph_launch(&graphs[g]);
+            task_graph_synchronize(&graphs[g]);
+            trace_end("graph", t0, iter, -1);
+            const int last = iter + graph_iters - 1;
+            l2_norm = sum_norm();
+            if (print && (last % 100) < graph_iters) printf("%5d, %0.6f\n", last, l2_norm);
+            if (2 == num_graphs) {
+                for (domain_state& domain : domains) std::swap(domain.a_new, domain.a);
+                g = 1 - g;
+            }
+            iter += graph_iters;
+        }
+    }
+    while (l2_norm > tolerance && iter < iter_max) step();
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        stream_synchronize(&push_top_stream[dev_id]);
+        stream_synchronize(&push_bottom_stream[dev_id]);
+    }
+    *l2_norm_out = l2_norm;
+    return iter;
+}
+
+// Solve of -p2p: the domain loop of the main solve without the barrier between iterations. Every
+// domain synchronises only with its top and bottom neighbour through the sequence counters of
+// jacobi_sync.h: halo_top[d] and halo_bottom[d] count the iterations whose halo rows have arrived
+// in domain d. A domain waits until both reached iter before its sweep of iteration iter and
+// publishes iter + 1 into its neighbours' counters after pushing its boundary rows. The grids
+// alternate by the parity of iter, like the push_top_done[iter % 2] events of the GPU drivers,
+// and a neighbour is never more than one iteration ahead, so a push never overwrites a halo row
+// that is still read. Only iterations that check the norm wait for other domains, along the
+// reduction tree of jacobi_reduce.h. a and a_new are set to the final grids. Returns the number
+// of iterations.
+int p2p_cpu(std::vector<domain_state>& domains, const int nx, const int ny, const int pitch,
+            const int iter_max, const int nccheck, const real tolerance, const int num_threads,
+            const int block_x, const int block_y, const std::vector<cpu_set_t>& affinity,
+            const boundary_conditions& bc, const bool print, real* const l2_norm_out) {
+    const int num_domains = int(domains.size());
+    const bool periodic_y = BC_PERIODIC == bc.top.type;
+    std::vector<real*> grids[2] = {std::vector<real*>(num_domains),
+                                   std::vector<real*>(num_domains)};
+    for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+        grids[0][dev_id] = domains[dev_id].a;
+        grids[1][dev_id] = domains[dev_id].a_new;
+    }
+    std::vector<seq_flag> halo_top(num_domains);
+    std::vector<seq_flag> halo_bottom(num_domains);
+    norm_tree norm_reduction;
+    norm_tree_init(&norm_reduction, num_domains);
+    const int spins = num_domains * num_threads > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+    int iterations = 0;
+#pragma omp parallel num_threads(num_domains)
+    {
+        const int dev_id = omp_get_thread_num();
+        domain_state& domain = domains[dev_id];
+        const int top = dev_id > 0 ? dev_id - 1 : (num_domains - 1);
+        const int bottom = (dev_id + 1) % num_domains;
+        const cpu_set_t* const team_affinity =
+            affinity.empty() ? nullptr : &affinity[dev_id * num_threads];
+        int iter = 0;
+        uint32_t num_checks = 0;
+        real l2_norm = 1.0;
+
+        while (l2_norm > tolerance && iter < iter_max) {
+            const bool calculate_norm = (iter % nccheck) == 0 || (print && (iter % 100) == 0);
+            real* const dev_a = grids[iter % 2][dev_id];
+            real* const dev_a_new = grids[(iter + 1) % 2][dev_id];
+
+            uint64_t t0 = trace_begin();
+            seq_flag_wait(&halo_top[dev_id], iter, spins);
+            seq_flag_wait(&halo_bottom[dev_id], iter, spins);
+            trace_end("neighbour_wait", t0, iter, dev_id);
+
+            t0 = trace_begin();
+            const real dev_l2_norm =
+                jacobi_kernel(dev_a_new, dev_a, domain.iy_start, domain.iy_end, nx, pitch,
+                              num_threads, block_x, block_y, team_affinity, calculate_norm,
+                              domain.source);
+            bc_apply_columns(dev_a_new, bc, domain.iy_start, domain.iy_end, nx, pitch);
+            trace_end("compute", t0, iter, dev_id);
+
+            // Apply periodic boundary conditions, or the top and bottom boundary kernels at the
+            // first and last domain, which then publish their own halo rows
+            t0 = trace_begin();
+            const perf_values p0 = perf_begin();
+            if (periodic_y || dev_id > 0) {
+                std::memcpy(grids[(iter + 1) % 2][top] + domains[top].iy_end * pitch,
+                            dev_a_new + domain.iy_start * pitch, nx * sizeof(real));
+                seq_flag_publish(&halo_bottom[top], iter + 1);
+            } else {
+                bc_apply_row(dev_a_new, dev_a_new + domain.iy_start * pitch, bc.top, nx, ny);
+                seq_flag_publish(&halo_top[dev_id], iter + 1);
+            }
+            if (periodic_y || dev_id < num_domains - 1) {
+                std::memcpy(grids[(iter + 1) % 2][bottom], dev_a_new + (domain.iy_end - 1) * pitch,
+                            nx * sizeof(real));
+                seq_flag_publish(&halo_top[bottom], iter + 1);
+            } else {
+                bc_apply_row(dev_a_new + domain.iy_end * pitch,
+                             dev_a_new + (domain.iy_end - 1) * pitch, bc.bottom, nx, ny);
+                seq_flag_publish(&halo_bottom[dev_id], iter + 1);
+            }
+            perf_end(PERF_PHASE_HALO, p0);
+            trace_end("halo_push", t0, iter, dev_id);
+
+            if (calculate_norm) {
+                const uint64_t t1 = trace_begin();
+                const perf_values p1 = perf_begin();
+                l2_norm = std::sqrt(
+                    norm_tree_reduce(&norm_reduction, dev_id, ++num_checks, dev_l2_norm, spins));
+                perf_end(PERF_PHASE_REDUCTION, p1);
+                if (print && 0 == dev_id && (iter % 100) == 0)
+                    printf("%5d, %0.6f\n", iter, l2_norm);
+                trace_end("norm_reduction", t1, iter, dev_id);
+            }
+            iter++;
+        }
+        domain.a = grids[iter % 2][dev_id];
+        domain.a_new = grids[(iter + 1) % 2][dev_id];
+        if (0 == dev_id) {
+            iterations = iter;
+            *l2_norm_out = l2_norm;
+        }
+    }
+    return iterations;
+}
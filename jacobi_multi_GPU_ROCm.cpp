@@ -1,526 +1,728 @@
-#include <algorithm>
-#include <cmath>
-#include <cstdio>
-#include <iostream>
-#include <sstream>
-
-#include <omp.h>
-#include <hipcub/hipcub.hpp>
-#define HAVE_CUB 1
-#ifdef HAVE_CUB
-#include <hipcub/rocprim/block/block_reduce.hpp>
-#endif  // HAVE_CUB
-
-#ifdef USE_NVTX
-#include <nvToolsExt.h>
-
-const uint32_t colors[] = {0x0000ff00, 0x000000ff, 0x00ffff00, 0x00ff00ff,
-                           0x0000ffff, 0x00ff0000, 0x00ffffff};
-const int num_colors = sizeof(colors) / sizeof(uint32_t);
-
-#define PUSH_RANGE(name, cid)                              \
-    {                                                      \
-        int color_id = cid;                                \
-        color_id = color_id % num_colors;                  \
-        nvtxEventAttributes_t eventAttrib = {0};           \
-        eventAttrib.version = NVTX_VERSION;                \
-        eventAttrib.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;  \
-        eventAttrib.colorType = NVTX_COLOR_ARGB;           \
-        eventAttrib.color = colors[color_id];              \
-        eventAttrib.messageType = NVTX_MESSAGE_TYPE_ASCII; \
-        eventAttrib.message.ascii = name;                  \
-        nvtxRangePushEx(&eventAttrib);                     \
-    }
-#define POP_RANGE nvtxRangePop();
-#else
-#define PUSH_RANGE(name, cid)
-#define POP_RANGE
-#endif
-
-#define CUDA_RT_CALL(call)                                                                  \
-    {                                                                                       \
-        hipError_t cudaStatus = call;                                                      \
-        if (hipSuccess != cudaStatus)                                                      \
-            fprintf(stderr,                                                                 \
-                    "ERROR: CUDA RT call \"%s\" in line %d of file %s failed "              \
-                    "with "                                                                 \
-                    "%s (%d).\n",                                                           \
-                    #call, __LINE__, __FILE__, hipGetErrorString(cudaStatus), cudaStatus); \
-    }
-
-constexpr int MAX_NUM_DEVICES = 32;
-
-typedef float real;
-constexpr real tol = 1.0e-8;
-
-const real PI = 2.0 * std::asin(1.0);
-
-__global__ void initialize_boundaries(real* __restrict__ const a_new, real* __restrict__ const a,
-                                      const real pi, const int offset, const int nx,
-                                      const int my_ny, const int ny) {
-    for (int iy = blockIdx.x * blockDim.x + threadIdx.x; iy < my_ny; iy += blockDim.x * gridDim.x) {
-        const real y0 = sin(2.0 * pi * (offset + iy) / (ny - 1));
-        a[iy * nx + 0] = y0;
-        a[iy * nx + (nx - 1)] = y0;
-        a_new[iy * nx + 0] = y0;
-        a_new[iy * nx + (nx - 1)] = y0;
-    }
-}
-
-//template <int BLOCK_DIM_X, int BLOCK_DIM_Y>
-__global__ void jacobi_kernel(real* __restrict__ const a_new, const real* __restrict__ const a,
-                              real* __restrict__ const l2_norm, const int iy_start,
-                              const int iy_end, const int nx, const bool calculate_norm) {
-
-	const int BLOCK_DIM_X = 32;
-	const int BLOCK_DIM_Y = 4;
-#ifdef HAVE_CUB
-    typedef hipcub::BlockReduce<real, BLOCK_DIM_X, hipcub::BLOCK_REDUCE_WARP_REDUCTIONS, BLOCK_DIM_Y>
-        BlockReduce;
-    __shared__ typename BlockReduce::TempStorage temp_storage;
-#endif  // HAVE_CUB
-    int iy = blockIdx.y * blockDim.y + threadIdx.y + iy_start;
-    int ix = blockIdx.x * blockDim.x + threadIdx.x + 1;
-    real local_l2_norm = 0.0;
-
-    if (iy < iy_end && ix < (nx - 1)) {
-        const real new_val = 0.25 * (a[iy * nx + ix + 1] + a[iy * nx + ix - 1] +
-                                     a[(iy + 1) * nx + ix] + a[(iy - 1) * nx + ix]);
-        a_new[iy * nx + ix] = new_val;
-
-        if (calculate_norm) {
-            real residue = new_val - a[iy * nx + ix];
-            local_l2_norm += residue * residue;
-        }
-    }
-    if (calculate_norm) {
-#ifdef HAVE_CUB
-        real block_l2_norm = BlockReduce(temp_storage).Sum(local_l2_norm);
-        if (0 == threadIdx.y && 0 == threadIdx.x) atomicAdd(l2_norm, block_l2_norm);
-#else
-        atomicAdd(l2_norm, local_l2_norm);
-#endif  // HAVE_CUB
-    }
-}
-
-double single_gpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
-                  const int nccheck, const bool print);
-
-template <typename T>
-T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
-    T argval = default_val;
-    char** itr = std::find(begin, end, arg);
-    if (itr != end && ++itr != end) {
-        std::istringstream inbuf(*itr);
-        inbuf >> argval;
-    }
-    return argval;
-}
-
-bool get_arg(char** begin, char** end, const std::string& arg) {
-    char** itr = std::find(begin, end, arg);
-    if (itr != end) {
-        return true;
-    }
-    return false;
-}
-
-int main(int argc, char* argv[]) {
-    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
-    const int nccheck = get_argval<int>(argv, argv + argc, "-nccheck", 1);
-    const int nx = get_argval<int>(argv, argv + argc, "-nx", 7168);
-    const int ny = get_argval<int>(argv, argv + argc, "-ny", 7168);
-    const bool csv = get_arg(argv, argv + argc, "-csv");
-    const bool nop2p = get_arg(argv, argv + argc, "-nop2p");
-
-    real* a[MAX_NUM_DEVICES];
-    real* a_new[MAX_NUM_DEVICES];
-    real* a_ref_h;
-    real* a_h;
-    double runtime_serial = 0.0;
-
-    hipStream_t compute_stream[MAX_NUM_DEVICES];
-    hipStream_t push_top_stream[MAX_NUM_DEVICES];
-    hipStream_t push_bottom_stream[MAX_NUM_DEVICES];
-    hipEvent_t compute_done[MAX_NUM_DEVICES];
-    hipEvent_t push_top_done[2][MAX_NUM_DEVICES];
-    hipEvent_t push_bottom_done[2][MAX_NUM_DEVICES];
-
-    real* l2_norm_d[MAX_NUM_DEVICES];
-    real* l2_norm_h[MAX_NUM_DEVICES];
-
-    int iy_start[MAX_NUM_DEVICES];
-    int iy_end[MAX_NUM_DEVICES];
-
-    int chunk_size[MAX_NUM_DEVICES];
-
-    int num_devices = 0;
-    CUDA_RT_CALL(hipGetDeviceCount(&num_devices));
-    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-        CUDA_RT_CALL(hipSetDevice(dev_id));
-        CUDA_RT_CALL(hipFree(0));
-
-        if (0 == dev_id) {
-            CUDA_RT_CALL(hipHostMalloc(&a_ref_h, nx * ny * sizeof(real)));
-            CUDA_RT_CALL(hipHostMalloc(&a_h, nx * ny * sizeof(real)));
-            runtime_serial = single_gpu(nx, ny, iter_max, a_ref_h, nccheck, !csv);
-        }
-
-        // ny - 2 rows are distributed amongst `size` ranks in such a way
-        // that each rank gets either (ny - 2) / size or (ny - 2) / size + 1 rows.
-        // This optimizes load balancing when (ny - 2) % size != 0
-        int chunk_size_low = (ny - 2) / num_devices;
-        int chunk_size_high = chunk_size_low + 1;
-        // To calculate the number of ranks that need to compute an extra row,
-        // the following formula is derived from this equation:
-        // num_ranks_low * chunk_size_low + (size - num_ranks_low) * (chunk_size_low + 1) = ny - 2
-        int num_ranks_low = num_devices * chunk_size_low + num_devices -
-                            (ny - 2);  // Number of ranks with chunk_size = chunk_size_low
-        if (dev_id < num_ranks_low)
-            chunk_size[dev_id] = chunk_size_low;
-        else
-            chunk_size[dev_id] = chunk_size_high;
-
-        CUDA_RT_CALL(hipMalloc(a + dev_id, nx * (chunk_size[dev_id] + 2) * sizeof(real)));
-        CUDA_RT_CALL(hipMalloc(a_new + dev_id, nx * (chunk_size[dev_id] + 2) * sizeof(real)));
-
-        CUDA_RT_CALL(hipMemset(a[dev_id], 0, nx * (chunk_size[dev_id] + 2) * sizeof(real)));
-        CUDA_RT_CALL(hipMemset(a_new[dev_id], 0, nx * (chunk_size[dev_id] + 2) * sizeof(real)));
-
-        // Calculate local domain boundaries
-        int iy_start_global;  // My start index in the global array
-        if (dev_id < num_ranks_low) {
-            iy_start_global = dev_id * chunk_size_low + 1;
-        } else {
-            iy_start_global =
-                num_ranks_low * chunk_size_low + (dev_id - num_ranks_low) * chunk_size_high + 1;
-        }
-        int iy_end_global =
-            iy_start_global + chunk_size[dev_id] - 1;  // My last index in the global array
-
-        iy_start[dev_id] = 1;
-        iy_end[dev_id] = iy_start[dev_id] + chunk_size[dev_id];
-
-        // Set diriclet boundary conditions on left and right boarder
-        hipLaunchKernelGGL((initialize_boundaries), dim3((ny / num_devices) / 128 + 1), dim3(128), 0, 0, 
-            a[dev_id], a_new[dev_id], PI, iy_start_global - 1, nx, (chunk_size[dev_id] + 2), ny);
-        CUDA_RT_CALL(hipGetLastError());
-        CUDA_RT_CALL(hipDeviceSynchronize());
-
-        CUDA_RT_CALL(hipStreamCreate(compute_stream + dev_id));
-        CUDA_RT_CALL(hipStreamCreate(push_top_stream + dev_id));
-        CUDA_RT_CALL(hipStreamCreate(push_bottom_stream + dev_id));
-        CUDA_RT_CALL(hipEventCreateWithFlags(compute_done + dev_id, hipEventDisableTiming));
-        CUDA_RT_CALL(hipEventCreateWithFlags(push_top_done[0] + dev_id, hipEventDisableTiming));
-        CUDA_RT_CALL(
-            hipEventCreateWithFlags(push_bottom_done[0] + dev_id, hipEventDisableTiming));
-        CUDA_RT_CALL(hipEventCreateWithFlags(push_top_done[1] + dev_id, hipEventDisableTiming));
-        CUDA_RT_CALL(
-            hipEventCreateWithFlags(push_bottom_done[1] + dev_id, hipEventDisableTiming));
-
-        CUDA_RT_CALL(hipMalloc(l2_norm_d + dev_id, sizeof(real)));
-        CUDA_RT_CALL(hipHostMalloc(l2_norm_h + dev_id, sizeof(real)));
-
-        if (!nop2p) {
-            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
-            int canAccessPeer = 0;
-            CUDA_RT_CALL(hipDeviceCanAccessPeer(&canAccessPeer, dev_id, top));
-            if (canAccessPeer) {
-                CUDA_RT_CALL(hipDeviceEnablePeerAccess(top, 0));
-            }
-            const int bottom = (dev_id + 1) % num_devices;
-            if (top != bottom) {
-                canAccessPeer = 0;
-                CUDA_RT_CALL(hipDeviceCanAccessPeer(&canAccessPeer, dev_id, bottom));
-                if (canAccessPeer) {
-                    CUDA_RT_CALL(hipDeviceEnablePeerAccess(bottom, 0));
-                }
-            }
-        }
-        CUDA_RT_CALL(hipDeviceSynchronize());
-    }
-
-    for (int i = 0; i < 5; ++i) {
-        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-            CUDA_RT_CALL(hipSetDevice(dev_id));
-            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
-            const int bottom = (dev_id + 1) % num_devices;
-            CUDA_RT_CALL(hipMemcpyAsync(a_new[top] + (iy_end[top] * nx),
-                                         a_new[dev_id] + iy_start[dev_id] * nx, nx * sizeof(real),
-                                         hipMemcpyDeviceToDevice, push_top_stream[dev_id]));
-            CUDA_RT_CALL(hipMemcpyAsync(a_new[bottom], a_new[dev_id] + (iy_end[dev_id] - 1) * nx,
-                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
-                                         push_bottom_stream[dev_id]));
-        }
-        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-            CUDA_RT_CALL(hipSetDevice(dev_id));
-            CUDA_RT_CALL(hipStreamSynchronize(push_top_stream[dev_id]));
-            CUDA_RT_CALL(hipStreamSynchronize(push_bottom_stream[dev_id]));
-        }
-    }
-
-    if (!csv)
-        printf(
-            "Jacobi relaxation: %d iterations on %d x %d mesh with norm check "
-            "every %d iterations\n",
-            iter_max, ny, nx, nccheck);
-
-    constexpr int dim_block_x = 32;
-    constexpr int dim_block_y = 4;
-	dim3 dimBlock (32,4,1);
-	//////////////////////////////////////////////////////////////
-    int iter = 0;
-    bool calculate_norm;
-    real l2_norm = 1.0;
-
-    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-        CUDA_RT_CALL(hipSetDevice(dev_id));
-        CUDA_RT_CALL(hipDeviceSynchronize());
-    }
-    double start = omp_get_wtime();
-    PUSH_RANGE("Jacobi solve", 0)
-    while (l2_norm > tol && iter < iter_max) {
-        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
-            const int bottom = (dev_id + 1) % num_devices;
-            CUDA_RT_CALL(hipSetDevice(dev_id));
-
-            CUDA_RT_CALL(
-                hipMemsetAsync(l2_norm_d[dev_id], 0, sizeof(real), compute_stream[dev_id]));
-
-            CUDA_RT_CALL(
-                hipStreamWaitEvent(compute_stream[dev_id], push_top_done[(iter % 2)][bottom], 0));
-            CUDA_RT_CALL(
-                hipStreamWaitEvent(compute_stream[dev_id], push_bottom_done[(iter % 2)][top], 0));
-
-            calculate_norm = (iter % nccheck) == 0 || (!csv && (iter % 100) == 0);
-            dim3 dim_grid((nx + dim_block_x - 1) / dim_block_x,
-                          (chunk_size[dev_id] + dim_block_y - 1) / dim_block_y, 1);
-		//<dim_block_x, dim_block_y>)
-            hipLaunchKernelGGL(jacobi_kernel, dim_grid, dimBlock, 0, compute_stream[dev_id],a_new[dev_id], a[dev_id], l2_norm_d[dev_id], iy_start[dev_id], iy_end[dev_id],nx, calculate_norm);
-            CUDA_RT_CALL(hipGetLastError());
-            CUDA_RT_CALL(hipEventRecord(compute_done[dev_id], compute_stream[dev_id]));
-
-            if (calculate_norm) {
-                CUDA_RT_CALL(hipMemcpyAsync(l2_norm_h[dev_id], l2_norm_d[dev_id], sizeof(real),
-                                             hipMemcpyDeviceToHost, compute_stream[dev_id]));
-            }
-
-            // Apply periodic boundary conditions
-            CUDA_RT_CALL(hipStreamWaitEvent(push_top_stream[dev_id], compute_done[dev_id], 0));
-            CUDA_RT_CALL(hipMemcpyAsync(a_new[top] + (iy_end[top] * nx),
-                                         a_new[dev_id] + iy_start[dev_id] * nx, nx * sizeof(real),
-                                         hipMemcpyDeviceToDevice, push_top_stream[dev_id]));
-            CUDA_RT_CALL(
-                hipEventRecord(push_top_done[((iter + 1) % 2)][dev_id], push_top_stream[dev_id]));
-
-            CUDA_RT_CALL(hipStreamWaitEvent(push_bottom_stream[dev_id], compute_done[dev_id], 0));
-            CUDA_RT_CALL(hipMemcpyAsync(a_new[bottom], a_new[dev_id] + (iy_end[dev_id] - 1) * nx,
-                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
-                                         push_bottom_stream[dev_id]));
-            CUDA_RT_CALL(hipEventRecord(push_bottom_done[((iter + 1) % 2)][dev_id],
-                                         push_bottom_stream[dev_id]));
-        }
-        if (calculate_norm) {
-            l2_norm = 0.0;
-            for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-                CUDA_RT_CALL(hipStreamSynchronize(compute_stream[dev_id]));
-                l2_norm += *(l2_norm_h[dev_id]);
-            }
-
-            l2_norm = std::sqrt(l2_norm);
-            if (!csv && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
-        }
-
-        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-            std::swap(a_new[dev_id], a[dev_id]);
-        }
-        iter++;
-    }
-    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-        CUDA_RT_CALL(hipSetDevice(dev_id));
-        CUDA_RT_CALL(hipDeviceSynchronize());
-    }
-    POP_RANGE
-    double stop = omp_get_wtime();
-
-    int offset = nx;
-    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
-        CUDA_RT_CALL(
-            hipMemcpy(a_h + offset, a[dev_id] + nx,
-                       std::min((nx * ny) - offset, nx * chunk_size[dev_id]) * sizeof(real),
-                       hipMemcpyDeviceToHost));
-        offset += std::min(chunk_size[dev_id] * nx, (nx * ny) - offset);
-    }
-
-    bool result_correct = true;
-    for (int iy = 1; result_correct && (iy < (ny - 1)); ++iy) {
-        for (int ix = 1; result_correct && (ix < (nx - 1)); ++ix) {
-            if (std::fabs(a_ref_h[iy * nx + ix] - a_h[iy * nx + ix]) > tol) {
-                fprintf(stderr,
-                        "ERROR: a[%d * %d + %d] = %f does not match %f "
-                        "(reference)\n",
-                        iy, nx, ix, a_h[iy * nx + ix], a_ref_h[iy * nx + ix]);
-                result_correct = false;
-            }
-        }
-    }
-
-    if (result_correct) {
-        if (csv) {
-            printf("single_threaded_copy, %d, %d, %d, %d, %d, %d, %f, %f\n", nx, ny, iter_max,
-                   nccheck, num_devices, nop2p ? 0 : 1, (stop - start), runtime_serial);
-        } else {
-            printf("Num GPUs: %d.\n", num_devices);
-            printf(
-                "%dx%d: 1 GPU: %8.4f s, %d GPUs: %8.4f s, speedup: %8.2f, "
-                "efficiency: %8.2f \n",
-                ny, nx, runtime_serial, num_devices, (stop - start),
-                runtime_serial / (stop - start),
-                runtime_serial / (num_devices * (stop - start)) * 100);
-        }
-    }
-
-    for (int dev_id = (num_devices - 1); dev_id >= 0; --dev_id) {
-        CUDA_RT_CALL(hipSetDevice(dev_id));
-        CUDA_RT_CALL(hipEventDestroy(push_bottom_done[1][dev_id]));
-        CUDA_RT_CALL(hipEventDestroy(push_top_done[1][dev_id]));
-        CUDA_RT_CALL(hipEventDestroy(push_bottom_done[0][dev_id]));
-        CUDA_RT_CALL(hipEventDestroy(push_top_done[0][dev_id]));
-        CUDA_RT_CALL(hipEventDestroy(compute_done[dev_id]));
-        CUDA_RT_CALL(hipStreamDestroy(push_bottom_stream[dev_id]));
-        CUDA_RT_CALL(hipStreamDestroy(push_top_stream[dev_id]));
-        CUDA_RT_CALL(hipStreamDestroy(compute_stream[dev_id]));
-
-        CUDA_RT_CALL(hipHostFree(l2_norm_h[dev_id]));
-        CUDA_RT_CALL(hipFree(l2_norm_d[dev_id]));
-
-        CUDA_RT_CALL(hipFree(a_new[dev_id]));
-        CUDA_RT_CALL(hipFree(a[dev_id]));
-        if (0 == dev_id) {
-            CUDA_RT_CALL(hipHostFree(a_h));
-            CUDA_RT_CALL(hipHostFree(a_ref_h));
-        }
-    }
-
-    return result_correct ? 0 : 1;
-}
-
-double single_gpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
-                  const int nccheck, const bool print) {
-    real* a;
-    real* a_new;
-
-    hipStream_t compute_stream;
-    hipStream_t push_top_stream;
-    hipStream_t push_bottom_stream;
-    hipEvent_t compute_done;
-    hipEvent_t push_top_done;
-    hipEvent_t push_bottom_done;
-
-    real* l2_norm_d;
-    real* l2_norm_h;
-
-    int iy_start = 1;
-    int iy_end = (ny - 1);
-
-    CUDA_RT_CALL(hipMalloc(&a, nx * ny * sizeof(real)));
-    CUDA_RT_CALL(hipMalloc(&a_new, nx * ny * sizeof(real)));
-
-    CUDA_RT_CALL(hipMemset(a, 0, nx * ny * sizeof(real)));
-    CUDA_RT_CALL(hipMemset(a_new, 0, nx * ny * sizeof(real)));
-
-    // Set diriclet boundary conditions on left and right boarder
-    hipLaunchKernelGGL((initialize_boundaries), dim3(ny / 128 + 1), dim3(128), 0, 0, a, a_new, PI, 0, nx, ny, ny);
-    CUDA_RT_CALL(hipGetLastError());
-    CUDA_RT_CALL(hipDeviceSynchronize());
-
-    CUDA_RT_CALL(hipStreamCreate(&compute_stream));
-    CUDA_RT_CALL(hipStreamCreate(&push_top_stream));
-    CUDA_RT_CALL(hipStreamCreate(&push_bottom_stream));
-    CUDA_RT_CALL(hipEventCreateWithFlags(&compute_done, hipEventDisableTiming));
-    CUDA_RT_CALL(hipEventCreateWithFlags(&push_top_done, hipEventDisableTiming));
-    CUDA_RT_CALL(hipEventCreateWithFlags(&push_bottom_done, hipEventDisableTiming));
-
-    CUDA_RT_CALL(hipMalloc(&l2_norm_d, sizeof(real)));
-    CUDA_RT_CALL(hipHostMalloc(&l2_norm_h, sizeof(real)));
-
-    CUDA_RT_CALL(hipDeviceSynchronize());
-
-    if (print)
-        printf(
-            "Single GPU jacobi relaxation: %d iterations on %d x %d mesh with "
-            "norm "
-            "check every %d iterations\n",
-            iter_max, ny, nx, nccheck);
-
-    constexpr int dim_block_x = 32;
-    constexpr int dim_block_y = 4;
-	dim3 dimBlock (32,4,1);
-/////////////////////////////////////////////////
-    dim3 dim_grid((nx + dim_block_x - 1) / dim_block_x, (ny + dim_block_y - 1) / dim_block_y, 1);
-
-    int iter = 0;
-    bool calculate_norm;
-    real l2_norm = 1.0;
-
-    double start = omp_get_wtime();
-    PUSH_RANGE("Jacobi solve", 0)
-    while (l2_norm > tol && iter < iter_max) {
-        CUDA_RT_CALL(hipMemsetAsync(l2_norm_d, 0, sizeof(real), compute_stream));
-
-        CUDA_RT_CALL(hipStreamWaitEvent(compute_stream, push_top_done, 0));
-        CUDA_RT_CALL(hipStreamWaitEvent(compute_stream, push_bottom_done, 0));
-
-        calculate_norm = (iter % nccheck) == 0 || (print && ((iter % 100) == 0));
-	//<dim_block_x, dim_block_y>
-        hipLaunchKernelGGL(jacobi_kernel, dim_grid, dimBlock, 0, compute_stream, a_new, a, l2_norm_d, iy_start, iy_end, nx, calculate_norm);
-        CUDA_RT_CALL(hipGetLastError());
-        CUDA_RT_CALL(hipEventRecord(compute_done, compute_stream));
-
-        if (calculate_norm) {
-            CUDA_RT_CALL(hipMemcpyAsync(l2_norm_h, l2_norm_d, sizeof(real), hipMemcpyDeviceToHost,
-                                         compute_stream));
-        }
-
-        // Apply periodic boundary conditions
-
-        CUDA_RT_CALL(hipStreamWaitEvent(push_top_stream, compute_done, 0));
-        CUDA_RT_CALL(hipMemcpyAsync(a_new, a_new + (iy_end - 1) * nx, nx * sizeof(real),
-                                     hipMemcpyDeviceToDevice, push_top_stream));
-        CUDA_RT_CALL(hipEventRecord(push_top_done, push_top_stream));
-
-        CUDA_RT_CALL(hipStreamWaitEvent(push_bottom_stream, compute_done, 0));
-        CUDA_RT_CALL(hipMemcpyAsync(a_new + iy_end * nx, a_new + iy_start * nx, nx * sizeof(real),
-                                     hipMemcpyDeviceToDevice, compute_stream));
-        CUDA_RT_CALL(hipEventRecord(push_bottom_done, push_bottom_stream));
-
-        if (calculate_norm) {
-            CUDA_RT_CALL(hipStreamSynchronize(compute_stream));
-            l2_norm = *l2_norm_h;
-            l2_norm = std::sqrt(l2_norm);
-            if (print && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
-        }
-
-        std::swap(a_new, a);
-        iter++;
-    }
-    POP_RANGE
-    double stop = omp_get_wtime();
-
-    CUDA_RT_CALL(hipMemcpy(a_ref_h, a, nx * ny * sizeof(real), hipMemcpyDeviceToHost));
-
-    CUDA_RT_CALL(hipEventDestroy(push_bottom_done));
-    CUDA_RT_CALL(hipEventDestroy(push_top_done));
-    CUDA_RT_CALL(hipEventDestroy(compute_done));
-    CUDA_RT_CALL(hipStreamDestroy(push_bottom_stream));
-    CUDA_RT_CALL(hipStreamDestroy(push_top_stream));
-    CUDA_RT_CALL(hipStreamDestroy(compute_stream));
-
-    CUDA_RT_CALL(hipHostFree(l2_norm_h));
-    CUDA_RT_CALL(hipFree(l2_norm_d));
-
-    CUDA_RT_CALL(hipFree(a_new));
-    CUDA_RT_CALL(hipFree(a));
-    return (stop - start);
-}
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_init.h"
+#include "jacobi_pitch.h"
+#include "jacobi_pool.h"
+#include "jacobi_trace.h"
+
+#include <hipcub/hipcub.hpp>
+#define HAVE_CUB 1
+#ifdef HAVE_CUB
+#include <hipcub/rocprim/block/block_reduce.hpp>
+#endif  // HAVE_CUB
+
+#ifdef USE_NVTX
+#include <nvToolsExt.h>
+
+const uint32_t colors[] = {0x0000ff00, 0x000000ff, 0x00ffff00, 0x00ff00ff,
+                           0x0000ffff, 0x00ff0000, 0x00ffffff};
+const int num_colors = sizeof(colors) / sizeof(uint32_t);
+
+#define PUSH_RANGE(name, cid)                              \
+    {                                                      \
+        int color_id = cid;                                \
+        color_id = color_id % num_colors;                  \
+        nvtxEventAttributes_t eventAttrib = {0};           \
+        eventAttrib.version = NVTX_VERSION;                \
+        eventAttrib.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;  \
+        eventAttrib.colorType = NVTX_COLOR_ARGB;           \
+        eventAttrib.color = colors[color_id];              \
+        eventAttrib.messageType = NVTX_MESSAGE_TYPE_ASCII; \
+        eventAttrib.message.ascii = name;                  \
+        nvtxRangePushEx(&eventAttrib);                     \
+    }
+#define POP_RANGE nvtxRangePop();
+#else
+#define PUSH_RANGE(name, cid)
+#define POP_RANGE
+#endif
+
+#define CUDA_RT_CALL(call)                                                                  \
+    {                                                                                       \
+        hipError_t cudaStatus = call;                                                      \
+        if (hipSuccess != cudaStatus)                                                      \
+            fprintf(stderr,                                                                 \
+                    "ERROR: CUDA RT call \"%s\" in line %d of file %s failed "              \
+                    "with "                                                                 \
+                    "%s (%d).\n",                                                           \
+                    #call, __LINE__, __FILE__, hipGetErrorString(cudaStatus), cudaStatus); \
+    }
+
+// Pinned host staging buffers (reference and result arrays, norm buffers), see jacobi_pool.h
+staging_pool pinned_pool(
+    [](size_t bytes) {
+        void* p = nullptr;
+        CUDA_RT_CALL(hipHostMalloc(&p, bytes));
+        return p;
+    },
+    [](void* p) { CUDA_RT_CALL(hipHostFree(p)); });
+
+typedef float real;
+constexpr real tol = 1.0e-8;
+
+const real PI = 2.0 * std::asin(1.0);
+
+__global__ void initialize_boundaries(real* __restrict__ const a_new, real* __restrict__ const a,
+                                      const real pi, const int offset, const int nx,
+                                      const int pitch, const int my_ny, const int ny) {
+    for (int iy = blockIdx.x * blockDim.x + threadIdx.x; iy < my_ny; iy += blockDim.x * gridDim.x) {
+        const real y0 = sin(2.0 * pi * (offset + iy) / (ny - 1));
+        a[iy * pitch + 0] = y0;
+        a[iy * pitch + (nx - 1)] = y0;
+        a_new[iy * pitch + 0] = y0;
+        a_new[iy * pitch + (nx - 1)] = y0;
+    }
+}
+
+//template <int BLOCK_DIM_X, int BLOCK_DIM_Y>
+__global__ void jacobi_kernel(real* __restrict__ const a_new, const real* __restrict__ const a,
+                              real* __restrict__ const l2_norm, const int iy_start,
+                              const int iy_end, const int nx, const int pitch,
+                              const bool calculate_norm) {
+
+	const int BLOCK_DIM_X = 32;
+	const int BLOCK_DIM_Y = 4;
+#ifdef HAVE_CUB
+    typedef hipcub::BlockReduce<real, BLOCK_DIM_X, hipcub::BLOCK_REDUCE_WARP_REDUCTIONS, BLOCK_DIM_Y>
+        BlockReduce;
+    __shared__ typename BlockReduce::TempStorage temp_storage;
+#endif  // HAVE_CUB
+    int iy = blockIdx.y * blockDim.y + threadIdx.y + iy_start;
+    int ix = blockIdx.x * blockDim.x + threadIdx.x + 1;
+    real local_l2_norm = 0.0;
+
+    if (iy < iy_end && ix < (nx - 1)) {
+        const real new_val = 0.25 * (a[iy * pitch + ix + 1] + a[iy * pitch + ix - 1] +
+                                     a[(iy + 1) * pitch + ix] + a[(iy - 1) * pitch + ix]);
+        a_new[iy * pitch + ix] = new_val;
+
+        if (calculate_norm) {
+            real residue = new_val - a[iy * pitch + ix];
+            local_l2_norm += residue * residue;
+        }
+    }
+    if (calculate_norm) {
+#ifdef HAVE_CUB
+        real block_l2_norm = BlockReduce(temp_storage).Sum(local_l2_norm);
+        if (0 == threadIdx.y && 0 == threadIdx.x) atomicAdd(l2_norm, block_l2_norm);
+#else
+        atomicAdd(l2_norm, local_l2_norm);
+#endif  // HAVE_CUB
+    }
+}
+
+// Adds the partial norm a child device copied into the inbox to the norm of its parent
+__global__ void add_norm(real* __restrict__ const l2_norm, const real* __restrict__ const partial) {
+    *l2_norm += *partial;
+}
+
+double single_gpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real* const init);
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    // -graph K replays graphs of K iterations that check the norm once
+    const int graph_iters = get_argval<int>(argv, argv + argc, "-graph", 0);
+    const int nccheck =
+        graph_iters > 0 ? graph_iters : get_argval<int>(argv, argv + argc, "-nccheck", 1);
+    const int nx = get_argval<int>(argv, argv + argc, "-nx", 7168);
+    const int ny = get_argval<int>(argv, argv + argc, "-ny", 7168);
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+    const bool nop2p = get_arg(argv, argv + argc, "-nop2p");
+    const std::string trace_file = get_argval<std::string>(argv, argv + argc, "-trace", "");
+    const std::string init_file = get_argval<std::string>(argv, argv + argc, "-init", "");
+    const std::string save_file = get_argval<std::string>(argv, argv + argc, "-save", "");
+
+    if (graph_iters < 0) {
+        fprintf(stderr, "ERROR: -graph must be at least 1\n");
+        return -1;
+    }
+    if (!trace_file.empty()) trace_enable();
+
+    // Initial guess from a saved field (jacobi_init.h), zero if none
+    std::vector<real> init;
+    if (!init_file.empty()) {
+        init.resize(size_t(nx) * ny);
+        if (!field_load(init_file, init.data(), nx, ny)) return -1;
+    }
+    const real* const init_h = init.empty() ? nullptr : init.data();
+
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    // Per-device state, sized by the devices found
+    int num_devices = 0;
+    CUDA_RT_CALL(hipGetDeviceCount(&num_devices));
+
+    std::vector<real*> a(num_devices);
+    std::vector<real*> a_new(num_devices);
+    real* a_ref_h;
+    real* a_h;
+    double runtime_serial = 0.0;
+
+    std::vector<hipStream_t> compute_stream(num_devices);
+    std::vector<hipStream_t> push_top_stream(num_devices);
+    std::vector<hipStream_t> push_bottom_stream(num_devices);
+    std::vector<hipEvent_t> compute_done(num_devices);
+    std::vector<hipEvent_t> norm_done(num_devices);
+    std::vector<hipEvent_t> push_top_done[2] = {std::vector<hipEvent_t>(num_devices),
+                                                std::vector<hipEvent_t>(num_devices)};
+    std::vector<hipEvent_t> push_bottom_done[2] = {std::vector<hipEvent_t>(num_devices),
+                                                   std::vector<hipEvent_t>(num_devices)};
+
+    // l2_norm_d[dev_id][0] is the norm of the device, [1] the inbox of its children's partials
+    std::vector<real*> l2_norm_d(num_devices);
+    real* l2_norm_h = nullptr;
+
+    std::vector<int> iy_start(num_devices);
+    std::vector<int> iy_end(num_devices);
+
+    std::vector<int> chunk_size(num_devices);
+
+    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+        CUDA_RT_CALL(hipSetDevice(dev_id));
+        CUDA_RT_CALL(hipFree(0));
+
+        if (0 == dev_id) {
+            a_ref_h = (real*)pool_alloc(&pinned_pool, nx * ny * sizeof(real));
+            a_h = (real*)pool_alloc(&pinned_pool, nx * ny * sizeof(real));
+            runtime_serial = single_gpu(nx, ny, iter_max, a_ref_h, nccheck, !csv, init_h);
+        }
+
+        // ny - 2 rows are distributed amongst `size` ranks in such a way
+        // that each rank gets either (ny - 2) / size or (ny - 2) / size + 1 rows.
+        // This optimizes load balancing when (ny - 2) % size != 0
+        int chunk_size_low = (ny - 2) / num_devices;
+        int chunk_size_high = chunk_size_low + 1;
+        // To calculate the number of ranks that need to compute an extra row,
+        // the following formula is derived from this equation:
+        // num_ranks_low * chunk_size_low + (size - num_ranks_low) * (chunk_size_low + 1) = ny - 2
+        int num_ranks_low = num_devices * chunk_size_low + num_devices -
+                            (ny - 2);  // Number of ranks with chunk_size = chunk_size_low
+        if (dev_id < num_ranks_low)
+            chunk_size[dev_id] = chunk_size_low;
+        else
+            chunk_size[dev_id] = chunk_size_high;
+
+        CUDA_RT_CALL(hipMalloc(&a[dev_id], pitch * (chunk_size[dev_id] + 2) * sizeof(real)));
+        CUDA_RT_CALL(hipMalloc(&a_new[dev_id], pitch * (chunk_size[dev_id] + 2) * sizeof(real)));
+
+        CUDA_RT_CALL(hipMemset(a[dev_id], 0, pitch * (chunk_size[dev_id] + 2) * sizeof(real)));
+        CUDA_RT_CALL(hipMemset(a_new[dev_id], 0, pitch * (chunk_size[dev_id] + 2) * sizeof(real)));
+
+        // Calculate local domain boundaries
+        int iy_start_global;  // My start index in the global array
+        if (dev_id < num_ranks_low) {
+            iy_start_global = dev_id * chunk_size_low + 1;
+        } else {
+            iy_start_global =
+                num_ranks_low * chunk_size_low + (dev_id - num_ranks_low) * chunk_size_high + 1;
+        }
+        int iy_end_global =
+            iy_start_global + chunk_size[dev_id] - 1;  // My last index in the global array
+
+        iy_start[dev_id] = 1;
+        iy_end[dev_id] = iy_start[dev_id] + chunk_size[dev_id];
+
+        // Set diriclet boundary conditions on left and right boarder
+        hipLaunchKernelGGL((initialize_boundaries), dim3((ny / num_devices) / 128 + 1), dim3(128), 0, 0, 
+            a[dev_id], a_new[dev_id], PI, iy_start_global - 1, nx, pitch, (chunk_size[dev_id] + 2),
+            ny);
+        CUDA_RT_CALL(hipGetLastError());
+        if (init_h)
+            CUDA_RT_CALL(hipMemcpy2D(a[dev_id] + 1, pitch * sizeof(real),
+                                     init_h + (iy_start_global - 1) * nx + 1, nx * sizeof(real),
+                                     (nx - 2) * sizeof(real), chunk_size[dev_id] + 2,
+                                     hipMemcpyHostToDevice));
+        CUDA_RT_CALL(hipDeviceSynchronize());
+
+        CUDA_RT_CALL(hipStreamCreate(&compute_stream[dev_id]));
+        CUDA_RT_CALL(hipStreamCreate(&push_top_stream[dev_id]));
+        CUDA_RT_CALL(hipStreamCreate(&push_bottom_stream[dev_id]));
+        CUDA_RT_CALL(hipEventCreateWithFlags(&compute_done[dev_id], hipEventDisableTiming));
+        CUDA_RT_CALL(hipEventCreateWithFlags(&norm_done[dev_id], hipEventDisableTiming));
+        CUDA_RT_CALL(hipEventCreateWithFlags(&push_top_done[0][dev_id], hipEventDisableTiming));
+        CUDA_RT_CALL(
+            hipEventCreateWithFlags(&push_bottom_done[0][dev_id], hipEventDisableTiming));
+        CUDA_RT_CALL(hipEventCreateWithFlags(&push_top_done[1][dev_id], hipEventDisableTiming));
+        CUDA_RT_CALL(
+            hipEventCreateWithFlags(&push_bottom_done[1][dev_id], hipEventDisableTiming));
+
+        CUDA_RT_CALL(hipMalloc(&l2_norm_d[dev_id], 2 * sizeof(real)));
+        if (0 == dev_id) l2_norm_h = (real*)pool_alloc(&pinned_pool, sizeof(real));
+
+        if (!nop2p) {
+            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
+            int canAccessPeer = 0;
+            CUDA_RT_CALL(hipDeviceCanAccessPeer(&canAccessPeer, dev_id, top));
+            if (canAccessPeer) {
+                CUDA_RT_CALL(hipDeviceEnablePeerAccess(top, 0));
+            }
+            const int bottom = (dev_id + 1) % num_devices;
+            if (top != bottom) {
+                canAccessPeer = 0;
+                CUDA_RT_CALL(hipDeviceCanAccessPeer(&canAccessPeer, dev_id, bottom));
+                if (canAccessPeer) {
+                    CUDA_RT_CALL(hipDeviceEnablePeerAccess(bottom, 0));
+                }
+            }
+        }
+        CUDA_RT_CALL(hipDeviceSynchronize());
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
+            const int bottom = (dev_id + 1) % num_devices;
+            CUDA_RT_CALL(hipMemcpyAsync(a_new[top] + (iy_end[top] * pitch),
+                                         a_new[dev_id] + iy_start[dev_id] * pitch,
+                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
+                                         push_top_stream[dev_id]));
+            CUDA_RT_CALL(hipMemcpyAsync(a_new[bottom],
+                                         a_new[dev_id] + (iy_end[dev_id] - 1) * pitch,
+                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
+                                         push_bottom_stream[dev_id]));
+        }
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+            CUDA_RT_CALL(hipStreamSynchronize(push_top_stream[dev_id]));
+            CUDA_RT_CALL(hipStreamSynchronize(push_bottom_stream[dev_id]));
+        }
+    }
+
+    if (!csv)
+        printf(
+            "Jacobi relaxation: %d iterations on %d x %d mesh with norm check "
+            "every %d iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    constexpr int dim_block_x = 32;
+    constexpr int dim_block_y = 4;
+	dim3 dimBlock (32,4,1);
+	//////////////////////////////////////////////////////////////
+    int iter = 0;
+    real l2_norm = 1.0;
+
+    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+        CUDA_RT_CALL(hipSetDevice(dev_id));
+        CUDA_RT_CALL(hipDeviceSynchronize());
+    }
+    // Sums the norms of iteration iter on the devices along a binary tree and copies the sum to
+    // l2_norm_h on compute_stream[0]. In round k device d with d % 2^(k+1) == 0 waits for device
+    // d + 2^k, copies its norm into the inbox of d and adds it to its own. Each device waits for at
+    // most log2(N) children, the host only for device 0, and the sums are added in the same order
+    // on every check.
+    auto reduce_norm = [&](const int iter) {
+        uint64_t t0 = trace_begin();
+        for (int stride = 1; stride < num_devices; stride *= 2) {
+            for (int dev_id = 0; dev_id + stride < num_devices; dev_id += 2 * stride) {
+                const int child = dev_id + stride;
+                CUDA_RT_CALL(hipSetDevice(child));
+                CUDA_RT_CALL(hipEventRecord(norm_done[child], compute_stream[child]));
+                CUDA_RT_CALL(hipSetDevice(dev_id));
+                CUDA_RT_CALL(hipStreamWaitEvent(compute_stream[dev_id], norm_done[child], 0));
+                CUDA_RT_CALL(hipMemcpyPeerAsync(l2_norm_d[dev_id] + 1, dev_id, l2_norm_d[child],
+                                                child, sizeof(real), compute_stream[dev_id]));
+                hipLaunchKernelGGL(add_norm, dim3(1), dim3(1), 0, compute_stream[dev_id],
+                                   l2_norm_d[dev_id], l2_norm_d[dev_id] + 1);
+                CUDA_RT_CALL(hipGetLastError());
+            }
+        }
+        CUDA_RT_CALL(hipSetDevice(0));
+        CUDA_RT_CALL(hipMemcpyAsync(l2_norm_h, l2_norm_d[0], sizeof(real), hipMemcpyDeviceToHost,
+                                    compute_stream[0]));
+        trace_end("norm_reduction", t0, iter, -1);
+    };
+    // Launches iteration iter on all devices. wait_push is false for the first iteration of a
+    // graph, which the graph launch orders after the previous one.
+    auto launch_iteration = [&](const int iter, const bool calculate_norm, const bool wait_push) {
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            const int top = dev_id > 0 ? dev_id - 1 : (num_devices - 1);
+            const int bottom = (dev_id + 1) % num_devices;
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+
+            uint64_t t0 = trace_begin();
+            CUDA_RT_CALL(
+                hipMemsetAsync(l2_norm_d[dev_id], 0, sizeof(real), compute_stream[dev_id]));
+
+            if (wait_push) {
+                CUDA_RT_CALL(hipStreamWaitEvent(compute_stream[dev_id],
+                                                 push_top_done[(iter % 2)][bottom], 0));
+                CUDA_RT_CALL(hipStreamWaitEvent(compute_stream[dev_id],
+                                                 push_bottom_done[(iter % 2)][top], 0));
+            }
+
+            dim3 dim_grid((nx + dim_block_x - 1) / dim_block_x,
+                          (chunk_size[dev_id] + dim_block_y - 1) / dim_block_y, 1);
+		//<dim_block_x, dim_block_y>)
+            hipLaunchKernelGGL(jacobi_kernel, dim_grid, dimBlock, 0, compute_stream[dev_id],a_new[dev_id], a[dev_id], l2_norm_d[dev_id], iy_start[dev_id], iy_end[dev_id],nx, pitch, calculate_norm);
+            CUDA_RT_CALL(hipGetLastError());
+            CUDA_RT_CALL(hipEventRecord(compute_done[dev_id], compute_stream[dev_id]));
+
+            trace_end("compute", t0, iter, dev_id);
+
+            // Apply periodic boundary conditions
+            t0 = trace_begin();
+            CUDA_RT_CALL(hipStreamWaitEvent(push_top_stream[dev_id], compute_done[dev_id], 0));
+            CUDA_RT_CALL(hipMemcpyAsync(a_new[top] + (iy_end[top] * pitch),
+                                         a_new[dev_id] + iy_start[dev_id] * pitch,
+                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
+                                         push_top_stream[dev_id]));
+            CUDA_RT_CALL(
+                hipEventRecord(push_top_done[((iter + 1) % 2)][dev_id], push_top_stream[dev_id]));
+
+            CUDA_RT_CALL(hipStreamWaitEvent(push_bottom_stream[dev_id], compute_done[dev_id], 0));
+            CUDA_RT_CALL(hipMemcpyAsync(a_new[bottom],
+                                         a_new[dev_id] + (iy_end[dev_id] - 1) * pitch,
+                                         nx * sizeof(real), hipMemcpyDeviceToDevice,
+                                         push_bottom_stream[dev_id]));
+            CUDA_RT_CALL(hipEventRecord(push_bottom_done[((iter + 1) % 2)][dev_id],
+                                         push_bottom_stream[dev_id]));
+            trace_end("halo_push", t0, iter, dev_id);
+        }
+        if (calculate_norm) reduce_norm(iter);
+    };
+    // Launches iteration iter and, if it checks the norm, waits for it
+    auto step = [&]() {
+        const bool calculate_norm = (iter % nccheck) == 0 || (!csv && (iter % 100) == 0);
+        launch_iteration(iter, calculate_norm, true);
+        if (calculate_norm) {
+            uint64_t t0 = trace_begin();
+            // The tree ends on compute_stream[0], which also orders the copies of all devices
+            // before the next iteration resets their norms
+            CUDA_RT_CALL(hipSetDevice(0));
+            CUDA_RT_CALL(hipStreamSynchronize(compute_stream[0]));
+            trace_end("host_wait", t0, iter, 0);
+            l2_norm = std::sqrt(*l2_norm_h);
+            if (!csv && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            std::swap(a_new[dev_id], a[dev_id]);
+        }
+        iter++;
+    };
+
+    double start = omp_get_wtime();
+    uint64_t solve_start = trace_begin();
+    PUSH_RANGE("Jacobi solve", 0)
+    if (graph_iters > 0 && graph_iters < iter_max) {
+        // -graph: capture graph_iters iterations of all devices into one graph on graph_stream
+        // and replay it. The device streams fork from and join into graph_stream. Iteration 0
+        // runs on its own, so that the last iteration of a replay, the only one that checks the
+        // norm, is a multiple of graph_iters like the checks of -nccheck. An odd count ends with
+        // a and a_new swapped, a second graph starts there.
+        step();
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+            CUDA_RT_CALL(hipDeviceSynchronize());
+        }
+        hipStream_t graph_stream;
+        hipEvent_t graph_fork;
+        std::vector<std::array<hipEvent_t, 3>> graph_join(num_devices);
+        CUDA_RT_CALL(hipSetDevice(0));
+        CUDA_RT_CALL(hipStreamCreate(&graph_stream));
+        CUDA_RT_CALL(hipEventCreateWithFlags(&graph_fork, hipEventDisableTiming));
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+            for (int s = 0; s < 3; ++s) {
+                CUDA_RT_CALL(
+                    hipEventCreateWithFlags(&graph_join[dev_id][s], hipEventDisableTiming));
+            }
+        }
+
+        const int num_graphs = graph_iters % 2 ? 2 : 1;
+        hipGraphExec_t graph_exec[2];
+        for (int g = 0; g < num_graphs; ++g) {
+            hipGraph_t graph;
+            CUDA_RT_CALL(hipSetDevice(0));
+            CUDA_RT_CALL(hipStreamBeginCapture(graph_stream, hipStreamCaptureModeGlobal));
+            CUDA_RT_CALL(hipEventRecord(graph_fork, graph_stream));
+            for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+                CUDA_RT_CALL(hipSetDevice(dev_id));
+                CUDA_RT_CALL(hipStreamWaitEvent(compute_stream[dev_id], graph_fork, 0));
+                CUDA_RT_CALL(hipStreamWaitEvent(push_top_stream[dev_id], graph_fork, 0));
+                CUDA_RT_CALL(hipStreamWaitEvent(push_bottom_stream[dev_id], graph_fork, 0));
+            }
+            for (int i = 0; i < graph_iters; ++i) {
+                launch_iteration(iter + i, graph_iters - 1 == i, i > 0);
+                for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+                    std::swap(a_new[dev_id], a[dev_id]);
+                }
+            }
+            for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+                CUDA_RT_CALL(hipSetDevice(dev_id));
+                CUDA_RT_CALL(hipEventRecord(graph_join[dev_id][0], compute_stream[dev_id]));
+                CUDA_RT_CALL(hipEventRecord(graph_join[dev_id][1], push_top_stream[dev_id]));
+                CUDA_RT_CALL(hipEventRecord(graph_join[dev_id][2], push_bottom_stream[dev_id]));
+            }
+            CUDA_RT_CALL(hipSetDevice(0));
+            for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+                for (int s = 0; s < 3; ++s)
+                    CUDA_RT_CALL(hipStreamWaitEvent(graph_stream, graph_join[dev_id][s], 0));
+            }
+            CUDA_RT_CALL(hipStreamEndCapture(graph_stream, &graph));
+            CUDA_RT_CALL(hipGraphInstantiate(&graph_exec[g], graph, nullptr, nullptr, 0));
+            CUDA_RT_CALL(hipGraphDestroy(graph));
+        }
+        // The captures swapped the grids an even number of times, back to those of the first graph
+        int g = 0;
+        while (l2_norm > tol && iter + graph_iters <= iter_max) {
+            uint64_t t0 = trace_begin();
+            CUDA_RT_CALL(hipGraphLaunch(graph_exec[g], graph_stream));
+            CUDA_RT_CALL(hipStreamSynchronize(graph_stream));
+            trace_end("graph", t0, iter, -1);
+            const int last = iter + graph_iters - 1;
+            l2_norm = std::sqrt(*l2_norm_h);
+            if (!csv && (last % 100) < graph_iters) printf("%5d, %0.6f\n", last, l2_norm);
+            if (2 == num_graphs) {
+                for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+                    std::swap(a_new[dev_id], a[dev_id]);
+                }
+                g = 1 - g;
+            }
+            iter += graph_iters;
+        }
+
+        CUDA_RT_CALL(hipSetDevice(0));
+        for (int g = 0; g < num_graphs; ++g) CUDA_RT_CALL(hipGraphExecDestroy(graph_exec[g]));
+        for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+            CUDA_RT_CALL(hipSetDevice(dev_id));
+            for (int s = 0; s < 3; ++s) CUDA_RT_CALL(hipEventDestroy(graph_join[dev_id][s]));
+        }
+        CUDA_RT_CALL(hipSetDevice(0));
+        CUDA_RT_CALL(hipEventDestroy(graph_fork));
+        CUDA_RT_CALL(hipStreamDestroy(graph_stream));
+    }
+    while (l2_norm > tol && iter < iter_max) step();
+    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+        CUDA_RT_CALL(hipSetDevice(dev_id));
+        CUDA_RT_CALL(hipDeviceSynchronize());
+    }
+    POP_RANGE
+    trace_end("jacobi_solve", solve_start, -1, -1);
+    double stop = omp_get_wtime();
+
+    // Gather the pitched domains into the dense result
+    int offset = nx;
+    for (int dev_id = 0; dev_id < num_devices; ++dev_id) {
+        CUDA_RT_CALL(hipMemcpy2D(a_h + offset, nx * sizeof(real), a[dev_id] + pitch,
+                                 pitch * sizeof(real), nx * sizeof(real), chunk_size[dev_id],
+                                 hipMemcpyDeviceToHost));
+        offset += chunk_size[dev_id] * nx;
+    }
+    if (!save_file.empty()) {
+        field_periodic_halos(a_h, nx, ny);
+        if (!field_save(save_file, a_h, nx, ny)) return -1;
+    }
+
+    bool result_correct = true;
+    for (int iy = 1; result_correct && (iy < (ny - 1)); ++iy) {
+        for (int ix = 1; result_correct && (ix < (nx - 1)); ++ix) {
+            if (std::fabs(a_ref_h[iy * nx + ix] - a_h[iy * nx + ix]) > tol) {
+                fprintf(stderr,
+                        "ERROR: a[%d * %d + %d] = %f does not match %f "
+                        "(reference)\n",
+                        iy, nx, ix, a_h[iy * nx + ix], a_ref_h[iy * nx + ix]);
+                result_correct = false;
+            }
+        }
+    }
+
+    if (result_correct) {
+        if (csv) {
+            printf("single_threaded_copy, %d, %d, %d, %d, %d, %d, %f, %f\n", nx, ny, iter_max,
+                   nccheck, num_devices, nop2p ? 0 : 1, (stop - start), runtime_serial);
+        } else {
+            printf("Num GPUs: %d.\n", num_devices);
+            printf("Pinned staging buffers: %ld requests, %ld reused, %ld allocations in %8.4f s\n",
+                   pinned_pool.requests, pinned_pool.reused, pinned_pool.backend_allocs,
+                   pinned_pool.backend_seconds);
+            printf(
+                "%dx%d: 1 GPU: %8.4f s, %d GPUs: %8.4f s, speedup: %8.2f, "
+                "efficiency: %8.2f \n",
+                ny, nx, runtime_serial, num_devices, (stop - start),
+                runtime_serial / (stop - start),
+                runtime_serial / (num_devices * (stop - start)) * 100);
+        }
+    }
+
+    if (!trace_file.empty()) trace_dump(trace_file.c_str());
+
+    for (int dev_id = (num_devices - 1); dev_id >= 0; --dev_id) {
+        CUDA_RT_CALL(hipSetDevice(dev_id));
+        CUDA_RT_CALL(hipEventDestroy(push_bottom_done[1][dev_id]));
+        CUDA_RT_CALL(hipEventDestroy(push_top_done[1][dev_id]));
+        CUDA_RT_CALL(hipEventDestroy(push_bottom_done[0][dev_id]));
+        CUDA_RT_CALL(hipEventDestroy(push_top_done[0][dev_id]));
+        CUDA_RT_CALL(hipEventDestroy(norm_done[dev_id]));
+        CUDA_RT_CALL(hipEventDestroy(compute_done[dev_id]));
+        CUDA_RT_CALL(hipStreamDestroy(push_bottom_stream[dev_id]));
+        CUDA_RT_CALL(hipStreamDestroy(push_top_stream[dev_id]));
+        CUDA_RT_CALL(hipStreamDestroy(compute_stream[dev_id]));
+
+        if (0 == dev_id) pool_free(&pinned_pool, l2_norm_h);
+        CUDA_RT_CALL(hipFree(l2_norm_d[dev_id]));
+
+        CUDA_RT_CALL(hipFree(a_new[dev_id]));
+        CUDA_RT_CALL(hipFree(a[dev_id]));
+        if (0 == dev_id) {
+            pool_free(&pinned_pool, a_h);
+            pool_free(&pinned_pool, a_ref_h);
+        }
+    }
+    pool_destroy(&pinned_pool);
+
+    return result_correct ? 0 : 1;
+}
+
+double single_gpu(const int nx, const int ny, const int iter_max, real* const a_ref_h,
+                  const int nccheck, const bool print, const real* const init) {
+    real* a;
+    real* a_new;
+
+    hipStream_t compute_stream;
+    hipStream_t push_top_stream;
+    hipStream_t push_bottom_stream;
+    hipEvent_t compute_done;
+    hipEvent_t push_top_done;
+    hipEvent_t push_bottom_done;
+
+    real* l2_norm_d;
+    real* l2_norm_h;
+
+    int iy_start = 1;
+    int iy_end = (ny - 1);
+    const int pitch = row_pitch(nx, sizeof(real));
+
+    CUDA_RT_CALL(hipMalloc(&a, pitch * ny * sizeof(real)));
+    CUDA_RT_CALL(hipMalloc(&a_new, pitch * ny * sizeof(real)));
+
+    CUDA_RT_CALL(hipMemset(a, 0, pitch * ny * sizeof(real)));
+    CUDA_RT_CALL(hipMemset(a_new, 0, pitch * ny * sizeof(real)));
+
+    // Set diriclet boundary conditions on left and right boarder
+    hipLaunchKernelGGL((initialize_boundaries), dim3(ny / 128 + 1), dim3(128), 0, 0, a, a_new, PI, 0, nx, pitch, ny, ny);
+    CUDA_RT_CALL(hipGetLastError());
+    if (init)
+        CUDA_RT_CALL(hipMemcpy2D(a + 1, pitch * sizeof(real), init + 1, nx * sizeof(real),
+                                 (nx - 2) * sizeof(real), ny, hipMemcpyHostToDevice));
+    CUDA_RT_CALL(hipDeviceSynchronize());
+
+    CUDA_RT_CALL(hipStreamCreate(&compute_stream));
+    CUDA_RT_CALL(hipStreamCreate(&push_top_stream));
+    CUDA_RT_CALL(hipStreamCreate(&push_bottom_stream));
+    CUDA_RT_CALL(hipEventCreateWithFlags(&compute_done, hipEventDisableTiming));
+    CUDA_RT_CALL(hipEventCreateWithFlags(&push_top_done, hipEventDisableTiming));
+    CUDA_RT_CALL(hipEventCreateWithFlags(&push_bottom_done, hipEventDisableTiming));
+
+    CUDA_RT_CALL(hipMalloc(&l2_norm_d, sizeof(real)));
+    l2_norm_h = (real*)pool_alloc(&pinned_pool, sizeof(real));
+
+    CUDA_RT_CALL(hipDeviceSynchronize());
+
+    if (print)
+        printf(
+            "Single GPU jacobi relaxation: %d iterations on %d x %d mesh with "
+            "norm "
+            "check every %d iterations\n",
+            iter_max, ny, nx, nccheck);
+
+    constexpr int dim_block_x = 32;
+    constexpr int dim_block_y = 4;
+	dim3 dimBlock (32,4,1);
+/////////////////////////////////////////////////
+    dim3 dim_grid((nx + dim_block_x - 1) / dim_block_x, (ny + dim_block_y - 1) / dim_block_y, 1);
+
+    int iter = 0;
+    bool calculate_norm;
+    real l2_norm = 1.0;
+
+    double start = omp_get_wtime();
+    PUSH_RANGE("Jacobi solve", 0)
+    while (l2_norm > tol && iter < iter_max) {
+        CUDA_RT_CALL(hipMemsetAsync(l2_norm_d, 0, sizeof(real), compute_stream));
+
+        CUDA_RT_CALL(hipStreamWaitEvent(compute_stream, push_top_done, 0));
+        CUDA_RT_CALL(hipStreamWaitEvent(compute_stream, push_bottom_done, 0));
+
+        calculate_norm = (iter % nccheck) == 0 || (print && ((iter % 100) == 0));
+	//<dim_block_x, dim_block_y>
+        hipLaunchKernelGGL(jacobi_kernel, dim_grid, dimBlock, 0, compute_stream, a_new, a, l2_norm_d, iy_start, iy_end, nx, pitch, calculate_norm);
+        CUDA_RT_CALL(hipGetLastError());
+        CUDA_RT_CALL(hipEventRecord(compute_done, compute_stream));
+
+        if (calculate_norm) {
+            CUDA_RT_CALL(hipMemcpyAsync(l2_norm_h, l2_norm_d, sizeof(real), hipMemcpyDeviceToHost,
+                                         compute_stream));
+        }
+
+        // Apply periodic boundary conditions
+
+        CUDA_RT_CALL(hipStreamWaitEvent(push_top_stream, compute_done, 0));
+        CUDA_RT_CALL(hipMemcpyAsync(a_new, a_new + (iy_end - 1) * pitch, nx * sizeof(real),
+                                     hipMemcpyDeviceToDevice, push_top_stream));
+        CUDA_RT_CALL(hipEventRecord(push_top_done, push_top_stream));
+
+        CUDA_RT_CALL(hipStreamWaitEvent(push_bottom_stream, compute_done, 0));
+        CUDA_RT_CALL(hipMemcpyAsync(a_new + iy_end * pitch, a_new + iy_start * pitch,
+                                     nx * sizeof(real), hipMemcpyDeviceToDevice, compute_stream));
+        CUDA_RT_CALL(hipEventRecord(push_bottom_done, push_bottom_stream));
+
+        if (calculate_norm) {
+            CUDA_RT_CALL(hipStreamSynchronize(compute_stream));
+            l2_norm = *l2_norm_h;
+            l2_norm = std::sqrt(l2_norm);
+            if (print && (iter % 100) == 0) printf("%5d, %0.6f\n", iter, l2_norm);
+        }
+
+        std::swap(a_new, a);
+        iter++;
+    }
+    POP_RANGE
+    double stop = omp_get_wtime();
+
+    CUDA_RT_CALL(hipMemcpy2D(a_ref_h, nx * sizeof(real), a, pitch * sizeof(real),
+                             nx * sizeof(real), ny, hipMemcpyDeviceToHost));
+
+    CUDA_RT_CALL(hipEventDestroy(push_bottom_done));
+    CUDA_RT_CALL(hipEventDestroy(push_top_done));
+    CUDA_RT_CALL(hipEventDestroy(compute_done));
+    CUDA_RT_CALL(hipStreamDestroy(push_bottom_stream));
+    CUDA_RT_CALL(hipStreamDestroy(push_top_stream));
+    CUDA_RT_CALL(hipStreamDestroy(compute_stream));
+
+    pool_free(&pinned_pool, l2_norm_h);
+    CUDA_RT_CALL(hipFree(l2_norm_d));
+
+    CUDA_RT_CALL(hipFree(a_new));
+    CUDA_RT_CALL(hipFree(a));
+    return (stop - start);
+}
@@ -0,0 +1,195 @@
+// NUMA topology, thread pinning and page placement queries for the host backend.
+//
+// numa_discover() reads the CPUs of every NUMA node from sysfs, restricted to the CPUs this
+// process may run on. numa_affinity_masks() turns a policy into one CPU mask per thread, indexed
+// by dev_id * num_threads + team thread, or by the threads of all previous domains + team thread
+// if the domains have different thread counts:
+//   compact - consecutive threads on consecutive CPUs, filling one node after the other
+//   scatter - consecutive threads round-robin over the nodes
+//   numa    - every domain is confined to one node, its threads float within that node
+// numa_bind_thread() applies a mask to the calling thread (only when it changed), so it is cheap
+// enough to call at the start of every parallel region. numa_page_nodes() reports on which node
+// the pages of a buffer actually reside, using move_pages(2) in query mode.
+#ifndef JACOBI_NUMA_H
+#define JACOBI_NUMA_H
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum numa_policy {
+    NUMA_AFFINITY_NONE = 0,
+    NUMA_AFFINITY_COMPACT,
+    NUMA_AFFINITY_SCATTER,
+    NUMA_AFFINITY_NUMA
+};
+
+struct numa_node {
+    int id;
+    std::vector<int> cpus;
+};
+
+struct numa_topology {
+    std::vector<numa_node> nodes;  // nodes with at least one usable CPU, ordered by id
+    int max_node_id;
+};
+
+static inline bool numa_parse_policy(const std::string& name, numa_policy* policy) {
+    if (name == "none") {
+        *policy = NUMA_AFFINITY_NONE;
+    } else if (name == "compact") {
+        *policy = NUMA_AFFINITY_COMPACT;
+    } else if (name == "scatter") {
+        *policy = NUMA_AFFINITY_SCATTER;
+    } else if (name == "numa") {
+        *policy = NUMA_AFFINITY_NUMA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+static inline std::vector<int> numa_parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        const size_t dash = range.find('-');
+        const int first = std::atoi(range.c_str());
+        const int last = std::string::npos == dash ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+static inline numa_topology numa_discover() {
+    numa_topology topology;
+    topology.max_node_id = 0;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &allowed);
+    }
+
+    std::vector<int> node_ids;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(dir)) {
+            int id;
+            if (1 == sscanf(entry->d_name, "node%d", &id)) node_ids.push_back(id);
+        }
+        closedir(dir);
+    }
+    std::sort(node_ids.begin(), node_ids.end());
+    for (int id : node_ids) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string list;
+        std::getline(in, list);
+        numa_node node = {id, {}};
+        for (int cpu : numa_parse_cpulist(list))
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+        topology.max_node_id = std::max(topology.max_node_id, id);
+        if (!node.cpus.empty()) topology.nodes.push_back(node);
+    }
+    if (topology.nodes.empty()) {
+        // No sysfs NUMA information: one node with all usable CPUs
+        numa_node node = {0, {}};
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+        topology.nodes.push_back(node);
+    }
+    return topology;
+}
+
+// One mask per thread (domain_threads[dev_id] threads per domain), empty for NUMA_AFFINITY_NONE.
+static inline std::vector<cpu_set_t> numa_affinity_masks(const numa_topology& topology,
+                                                         const numa_policy policy,
+                                                         const std::vector<int>& domain_threads) {
+    std::vector<cpu_set_t> masks;
+    if (NUMA_AFFINITY_NONE == policy) return masks;
+    const int num_domains = domain_threads.size();
+    int total_threads = 0;
+    for (const int threads : domain_threads) total_threads += threads;
+    masks.resize(total_threads);
+    std::vector<int> all_cpus;
+    for (const numa_node& node : topology.nodes)
+        all_cpus.insert(all_cpus.end(), node.cpus.begin(), node.cpus.end());
+    const int num_nodes = topology.nodes.size();
+    int first_thread = 0;
+    for (int dev_id = 0; dev_id < num_domains; first_thread += domain_threads[dev_id++]) {
+        for (int t = 0; t < domain_threads[dev_id]; ++t) {
+            const int g = first_thread + t;
+            cpu_set_t& mask = masks[g];
+            CPU_ZERO(&mask);
+            if (NUMA_AFFINITY_COMPACT == policy) {
+                CPU_SET(all_cpus[g % all_cpus.size()], &mask);
+            } else if (NUMA_AFFINITY_SCATTER == policy) {
+                const numa_node& node = topology.nodes[g % num_nodes];
+                CPU_SET(node.cpus[(g / num_nodes) % node.cpus.size()], &mask);
+            } else {
+                const numa_node& node = topology.nodes[(dev_id * num_nodes) / num_domains];
+                for (int cpu : node.cpus) CPU_SET(cpu, &mask);
+            }
+        }
+    }
+    return masks;
+}
+
+// One mask per thread (num_domains * num_threads entries), empty for NUMA_AFFINITY_NONE.
+static inline std::vector<cpu_set_t> numa_affinity_masks(const numa_topology& topology,
+                                                         const numa_policy policy,
+                                                         const int num_domains,
+                                                         const int num_threads) {
+    return numa_affinity_masks(topology, policy, std::vector<int>(num_domains, num_threads));
+}
+
+static thread_local cpu_set_t numa_bound_mask;
+static thread_local bool numa_bound = false;
+
+static inline void numa_bind_thread(const cpu_set_t* mask) {
+    if (nullptr == mask || (numa_bound && CPU_EQUAL(&numa_bound_mask, mask))) return;
+    if (0 == sched_setaffinity(0, sizeof(cpu_set_t), mask)) {
+        numa_bound_mask = *mask;
+        numa_bound = true;
+    }
+}
+
+// Counts the pages of [p, p + bytes) per node (index = node id). Pages that were never touched
+// are counted in *not_present. Returns false if move_pages is not available.
+static inline bool numa_page_nodes(const void* p, const size_t bytes, const int max_node_id,
+                                   std::vector<long>* pages_per_node, long* not_present) {
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(p) & ~(page_size - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(p) + bytes;
+    pages_per_node->assign(max_node_id + 1, 0);
+    *not_present = 0;
+    constexpr int batch = 1024;
+    void* pages[batch];
+    int status[batch];
+    for (uintptr_t addr = begin; addr < end;) {
+        int count = 0;
+        for (; count < batch && addr < end; ++count, addr += page_size)
+            pages[count] = reinterpret_cast<void*>(addr);
+        if (syscall(SYS_move_pages, 0, count, pages, nullptr, status, 0) != 0) return false;
+        for (int i = 0; i < count; ++i) {
+            if (status[i] >= 0 && status[i] <= max_node_id)
+                (*pages_per_node)[status[i]] += 1;
+            else
+                *not_present += 1;
+        }
+    }
+    return true;
+}
+
+#endif  // JACOBI_NUMA_H
@@ -0,0 +1,111 @@
+// File I/O of the out-of-core host solver.
+//
+// The grid lives in a file of ny rows of pitch elements each (the in-memory pitched layout, see
+// jacobi_pitch.h), so a band of rows is one contiguous pread/pwrite. Band reads and write backs
+// are queued to a single I/O thread and complete in submission order, which lets the solver
+// prefetch the next band and write back the previous one while it computes. Every request gets a
+// ticket, ooc_io_wait() blocks until that request has completed.
+#ifndef JACOBI_OOC_H
+#define JACOBI_OOC_H
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct ooc_io {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<bool()>> queue;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    bool stop = false;
+    bool failed = false;
+};
+
+static bool ooc_pread(const int fd, void* const buf, const size_t bytes, const off_t offset) {
+    size_t done = 0;
+    while (done < bytes) {
+        const ssize_t n = pread(fd, static_cast<char*>(buf) + done, bytes - done, offset + done);
+        if (n < 0 && EINTR == errno) continue;
+        if (n <= 0) {
+            fprintf(stderr, "ERROR: reading %zu bytes at offset %lld failed: %s\n", bytes,
+                    (long long)offset, n < 0 ? strerror(errno) : "unexpected end of file");
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static bool ooc_pwrite(const int fd, const void* const buf, const size_t bytes,
+                       const off_t offset) {
+    size_t done = 0;
+    while (done < bytes) {
+        const ssize_t n =
+            pwrite(fd, static_cast<const char*>(buf) + done, bytes - done, offset + done);
+        if (n < 0 && EINTR == errno) continue;
+        if (n <= 0) {
+            fprintf(stderr, "ERROR: writing %zu bytes at offset %lld failed: %s\n", bytes,
+                    (long long)offset, n < 0 ? strerror(errno) : "no space");
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static void ooc_io_loop(ooc_io* io) {
+    std::unique_lock<std::mutex> lock(io->mutex);
+    while (true) {
+        io->cv.wait(lock, [io] { return io->stop || !io->queue.empty(); });
+        if (io->queue.empty()) return;
+        std::function<bool()> request = std::move(io->queue.front());
+        io->queue.pop_front();
+        lock.unlock();
+        const bool ok = request();
+        lock.lock();
+        io->failed = io->failed || !ok;
+        ++io->completed;
+        io->cv.notify_all();
+    }
+}
+
+static void ooc_io_start(ooc_io* io) { io->thread = std::thread(ooc_io_loop, io); }
+
+// Queues a request (returning false on failure) and returns its ticket.
+static uint64_t ooc_io_submit(ooc_io* io, std::function<bool()> request) {
+    std::lock_guard<std::mutex> lock(io->mutex);
+    io->queue.push_back(std::move(request));
+    io->cv.notify_all();
+    return ++io->submitted;
+}
+
+// Waits for the request with the given ticket (and all earlier ones). Returns false if any
+// request so far has failed.
+static bool ooc_io_wait(ooc_io* io, const uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(io->mutex);
+    io->cv.wait(lock, [io, ticket] { return io->completed >= ticket; });
+    return !io->failed;
+}
+
+static void ooc_io_stop(ooc_io* io) {
+    {
+        std::lock_guard<std::mutex> lock(io->mutex);
+        io->stop = true;
+        io->cv.notify_all();
+    }
+    io->thread.join();
+}
+
+#endif  // JACOBI_OOC_H
@@ -0,0 +1,80 @@
+// Row partitioning of the global grid into contiguous domains.
+//
+// The interior rows 1 .. ny - 2 are split into one chunk per domain; starts[d] is the first
+// global row of domain d and starts[num_domains] = ny - 1 the end of the last one. The drivers
+// split them evenly at startup, or with -weights in proportion to a weight per domain, given on
+// the command line or measured by a short calibration sweep, so that domains of different speed
+// (more or fewer threads, a different device) co-own the grid. -rebalance measures the time
+// every domain spends in its sweeps and repartitions them in proportion to the measured speed
+// (rows per second), so that a slower domain (a different SKU, or CPUs shared with other jobs)
+// stops setting the pace of all others. After a repartition every domain pulls the rows it
+// newly owns from their old owners, usually a few boundary rows of its neighbours.
+#ifndef JACOBI_PARTITION_H
+#define JACOBI_PARTITION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Parses a comma separated list of positive numbers. Returns false if it is not one.
+static inline bool partition_parse_list(const std::string& spec,
+                                        std::vector<double>* const values) {
+    values->clear();
+    size_t begin = 0;
+    while (begin <= spec.size()) {
+        const size_t comma = std::min(spec.find(',', begin), spec.size());
+        const std::string item = spec.substr(begin, comma - begin);
+        char* end = nullptr;
+        const double value = strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(value > 0.0)) return false;
+        values->push_back(value);
+        begin = comma + 1;
+    }
+    return true;
+}
+
+// Splits num_rows rows, starting at global row 1, into weights.size() contiguous chunks of at
+// least min_rows rows each, proportional to the weights otherwise.
+static inline void partition_weighted(const std::vector<double>& weights, const int num_rows,
+                                      const int min_rows, int* const starts) {
+    const int num_domains = weights.size();
+    const int free_rows = num_rows - num_domains * min_rows;
+    double total = 0.0;
+    for (const double weight : weights) total += weight;
+    // Rounding the cumulative weights keeps the chunks monotonic and their sum exact
+    double cumulative = 0.0;
+    for (int d = 0; d < num_domains; ++d) {
+        starts[d] = 1 + d * min_rows + int(std::lround(free_rows * (cumulative / total)));
+        cumulative += weights[d];
+    }
+    starts[num_domains] = 1 + num_rows;
+}
+
+// Domain that owns the interior global row iy
+static inline int partition_owner(const int* const starts, const int num_domains, const int iy) {
+    return int(std::upper_bound(starts, starts + num_domains + 1, iy) - starts) - 1;
+}
+
+// Partition in proportion to the speed of every domain, chunk_size[d] rows in seconds[d].
+// Returns false if the slowest domain would not get faster by at least min_gain (a fraction of
+// its time), so that timing noise does not move rows back and forth.
+static inline bool partition_rebalance(const int* const chunk_size, const double* const seconds,
+                                       const int num_domains, const int num_rows,
+                                       const double min_gain, int* const starts) {
+    std::vector<double> speed(num_domains);
+    double slowest = 0.0;
+    for (int d = 0; d < num_domains; ++d) {
+        if (seconds[d] <= 0.0) return false;
+        speed[d] = chunk_size[d] / seconds[d];
+        slowest = std::max(slowest, seconds[d]);
+    }
+    partition_weighted(speed, num_rows, 1, starts);
+    double predicted = 0.0;
+    for (int d = 0; d < num_domains; ++d)
+        predicted = std::max(predicted, (starts[d + 1] - starts[d]) / speed[d]);
+    return predicted < (1.0 - min_gain) * slowest;
+}
+
+#endif  // JACOBI_PARTITION_H
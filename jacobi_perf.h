@@ -0,0 +1,204 @@
+// Optional hardware performance counters via perf_event_open(2).
+//
+// Every thread that measures a phase opens its own counter group (cycles, instructions, LLC read
+// and write misses) on first use. perf_begin()/perf_end() read the group with a single read(2) and
+// add the difference to per-thread, per-phase totals which perf_total() sums after the solve.
+// Only user-space events of the calling thread are counted, so this works with the default
+// perf_event_paranoid setting of 2 and needs no external service.
+//
+// Usage:
+//     perf_values p0 = perf_begin();
+//     ... phase ...
+//     perf_end(PERF_PHASE_STENCIL, p0);
+#ifndef JACOBI_PERF_H
+#define JACOBI_PERF_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+constexpr int PERF_MAX_THREADS = 4096;
+constexpr int PERF_CACHE_LINE_BYTES = 64;
+
+enum perf_phase { PERF_PHASE_STENCIL = 0, PERF_PHASE_HALO, PERF_PHASE_REDUCTION, PERF_NUM_PHASES };
+
+enum perf_counter {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_READ_MISSES,
+    PERF_LLC_WRITE_MISSES,
+    PERF_NUM_COUNTERS
+};
+
+static const char* const perf_phase_names[PERF_NUM_PHASES] = {"stencil", "halo", "reduction"};
+
+static const uint32_t perf_event_types[PERF_NUM_COUNTERS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+static const uint64_t perf_event_configs[PERF_NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+struct perf_values {
+    uint64_t ns;
+    uint64_t v[PERF_NUM_COUNTERS];
+};
+
+struct perf_thread {
+    int fd[PERF_NUM_COUNTERS];    // -1 if the event could not be opened
+    int slot[PERF_NUM_COUNTERS];  // position of the event in the group read buffer
+    int num_open;
+    uint64_t calls[PERF_NUM_PHASES];
+    uint64_t ns[PERF_NUM_PHASES];
+    uint64_t totals[PERF_NUM_PHASES][PERF_NUM_COUNTERS];
+};
+
+static bool perf_on = false;
+static bool perf_supported[PERF_NUM_COUNTERS];
+static std::atomic<int> perf_num_threads{0};
+static perf_thread* perf_threads[PERF_MAX_THREADS];
+static thread_local perf_thread* perf_local = nullptr;
+static thread_local bool perf_local_failed = false;
+
+static inline uint64_t perf_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static inline int perf_open_event(const int counter, const int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_event_types[counter];
+    attr.config = perf_event_configs[counter];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // pid = 0, cpu = -1: count the calling thread on any CPU
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static inline perf_thread* perf_open_thread() {
+    perf_thread* thread = new perf_thread;
+    std::memset(thread, 0, sizeof(perf_thread));
+    thread->num_open = 0;
+    for (int c = 0; c < PERF_NUM_COUNTERS; ++c) {
+        thread->fd[c] = perf_open_event(c, 0 == c ? -1 : thread->fd[0]);
+        if (thread->fd[c] >= 0) {
+            thread->slot[c] = thread->num_open++;
+        } else if (0 == c) {
+            // No group leader, no counters
+            delete thread;
+            return nullptr;
+        }
+    }
+    const int slot = perf_num_threads.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= PERF_MAX_THREADS) {
+        for (int c = 0; c < PERF_NUM_COUNTERS; ++c)
+            if (thread->fd[c] >= 0) close(thread->fd[c]);
+        delete thread;
+        return nullptr;
+    }
+    perf_threads[slot] = thread;
+    return thread;
+}
+
+// Probes the counters in the calling thread. Returns false (and leaves collection disabled) if
+// perf_event_open is not available, e.g. in containers without PMU access.
+static inline bool perf_enable() {
+    perf_local = perf_open_thread();
+    if (nullptr == perf_local) {
+        perf_local_failed = true;
+        fprintf(stderr, "WARNING: perf_event_open failed (%s), counters disabled\n",
+                strerror(errno));
+        return false;
+    }
+    for (int c = 0; c < PERF_NUM_COUNTERS; ++c) perf_supported[c] = perf_local->fd[c] >= 0;
+    perf_on = true;
+    return true;
+}
+
+static inline void perf_read(const perf_thread* thread, perf_values& values) {
+    uint64_t buf[1 + PERF_NUM_COUNTERS];
+    values.ns = perf_clock_ns();
+    if (read(thread->fd[0], buf, sizeof(buf)) < (ssize_t)((1 + thread->num_open) * 8)) {
+        std::memset(values.v, 0, sizeof(values.v));
+        return;
+    }
+    for (int c = 0; c < PERF_NUM_COUNTERS; ++c)
+        values.v[c] = thread->fd[c] >= 0 ? buf[1 + thread->slot[c]] : 0;
+}
+
+static inline perf_thread* perf_this_thread() {
+    if (nullptr == perf_local && !perf_local_failed) {
+        perf_local = perf_open_thread();
+        perf_local_failed = nullptr == perf_local;
+    }
+    return perf_local;
+}
+
+static inline perf_values perf_begin() {
+    perf_values values = {};
+    if (!perf_on) return values;
+    const perf_thread* thread = perf_this_thread();
+    if (nullptr != thread) perf_read(thread, values);
+    return values;
+}
+
+static inline void perf_end(const perf_phase phase, const perf_values& begin) {
+    if (!perf_on) return;
+    perf_thread* thread = perf_this_thread();
+    if (nullptr == thread) return;
+    perf_values end;
+    perf_read(thread, end);
+    thread->calls[phase] += 1;
+    thread->ns[phase] += end.ns - begin.ns;
+    for (int c = 0; c < PERF_NUM_COUNTERS; ++c) thread->totals[phase][c] += end.v[c] - begin.v[c];
+}
+
+// Clears the totals of all threads, so that only the phases measured from here on are reported.
+// Call while no thread is measuring.
+static inline void perf_reset() {
+    const int num_threads = std::min(perf_num_threads.load(), PERF_MAX_THREADS);
+    for (int t = 0; t < num_threads; ++t) {
+        perf_thread* const thread = perf_threads[t];
+        std::memset(thread->calls, 0, sizeof(thread->calls));
+        std::memset(thread->ns, 0, sizeof(thread->ns));
+        std::memset(thread->totals, 0, sizeof(thread->totals));
+    }
+}
+
+// Sum of a counter over all threads. Call after the measured threads are done.
+static inline uint64_t perf_total(const perf_phase phase, const perf_counter counter) {
+    uint64_t total = 0;
+    const int num_threads = std::min(perf_num_threads.load(), PERF_MAX_THREADS);
+    for (int t = 0; t < num_threads; ++t) total += perf_threads[t]->totals[phase][counter];
+    return total;
+}
+
+// Sum of the time all threads spent in a phase.
+static inline uint64_t perf_total_ns(const perf_phase phase) {
+    uint64_t total = 0;
+    const int num_threads = std::min(perf_num_threads.load(), PERF_MAX_THREADS);
+    for (int t = 0; t < num_threads; ++t) total += perf_threads[t]->ns[phase];
+    return total;
+}
+
+// Estimated DRAM traffic of a phase: one cache line per LLC miss.
+static inline uint64_t perf_dram_bytes(const perf_phase phase) {
+    return (perf_total(phase, PERF_LLC_READ_MISSES) + perf_total(phase, PERF_LLC_WRITE_MISSES)) *
+           PERF_CACHE_LINE_BYTES;
+}
+
+#endif  // JACOBI_PERF_H
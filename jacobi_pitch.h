@@ -0,0 +1,23 @@
+// Pitched row layout of the grids.
+//
+// Rows are stored pitch elements apart instead of nx, so element (iy, ix) of a grid is at
+// iy * pitch + ix. The pitch is nx rounded up to whole 64 byte cache lines, so that every row and
+// with it every halo row starts cache line aligned, and to an odd number of cache lines, so that
+// the rows iy - 1, iy and iy + 1 read by the stencil never map to the same cache sets as they do
+// for power of two row lengths (e.g. nx = 1024 or 7168). The padding columns are never read.
+// Grids exchanged with the outside (reference and result arrays) stay dense with pitch nx.
+#ifndef JACOBI_PITCH_H
+#define JACOBI_PITCH_H
+
+#include <cstddef>
+
+constexpr int ROW_ALIGN_BYTES = 64;
+
+static inline int row_pitch(const int nx, const size_t elem_size) {
+    const int elems_per_line = ROW_ALIGN_BYTES / elem_size;
+    int lines = (nx + elems_per_line - 1) / elems_per_line;
+    if (0 == lines % 2) ++lines;
+    return lines * elems_per_line;
+}
+
+#endif  // JACOBI_PITCH_H
@@ -0,0 +1,128 @@
+// Size class pool of host staging buffers.
+//
+// Pinned (cudaMallocHost, hipHostMalloc) and huge page allocations are slow: the memory is mapped,
+// zeroed and, when pinned, locked and registered with the driver page by page before the call
+// returns. A staging_pool keeps released buffers in free lists by size class and hands them out
+// again to later requests of the same class, so successive solves in one process pay for every
+// buffer only once. Requests of up to POOL_SLAB_CLASS_BYTES (e.g. the one element norm buffers of
+// every device) are carved out of shared slabs, so they need one backend allocation for all of
+// them instead of one each. Buffers from the pool are not cleared.
+#ifndef JACOBI_POOL_H
+#define JACOBI_POOL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t POOL_MIN_CLASS_BYTES = 64;
+constexpr size_t POOL_SLAB_CLASS_BYTES = 4096;
+constexpr size_t POOL_SLAB_BYTES = 64 * 1024;
+
+struct staging_pool {
+    staging_pool(std::function<void*(size_t)> alloc, std::function<void(void*)> release)
+        : backend_alloc(alloc), backend_free(release) {}
+
+    std::function<void*(size_t)> backend_alloc;  // returns nullptr on failure
+    std::function<void(void*)> backend_free;
+    std::mutex mutex;
+    std::map<size_t, std::vector<void*>> free_blocks;  // Cached blocks by size class
+    std::unordered_map<void*, size_t> block_class;     // Size class of every block of the pool
+    std::vector<void*> slabs;
+
+    // Statistics: requests, requests served from a free list, backend allocations and the time
+    // spent in them
+    long requests = 0;
+    long reused = 0;
+    long backend_allocs = 0;
+    double backend_seconds = 0.0;
+};
+
+// Powers of two up to POOL_SLAB_CLASS_BYTES, above that quarter steps between powers of two, so
+// at most 25% of a large block is wasted.
+static inline size_t pool_size_class(const size_t bytes) {
+    size_t pow2 = POOL_MIN_CLASS_BYTES;
+    while (pow2 < bytes) pow2 *= 2;
+    if (pow2 <= POOL_SLAB_CLASS_BYTES) return pow2;
+    const size_t step = pow2 / 8;
+    return (bytes + step - 1) / step * step;
+}
+
+static inline void* pool_backend_alloc(staging_pool* pool, const size_t bytes) {
+    const auto start = std::chrono::steady_clock::now();
+    void* p = pool->backend_alloc(bytes);
+    pool->backend_seconds +=
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ++pool->backend_allocs;
+    return p;
+}
+
+// Returns a buffer of at least bytes bytes, or nullptr if the backend allocation fails.
+static inline void* pool_alloc(staging_pool* pool, const size_t bytes) {
+    const size_t size_class = pool_size_class(bytes);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    ++pool->requests;
+    std::vector<void*>& free_list = pool->free_blocks[size_class];
+    if (!free_list.empty()) {
+        void* p = free_list.back();
+        free_list.pop_back();
+        ++pool->reused;
+        return p;
+    }
+    if (size_class <= POOL_SLAB_CLASS_BYTES) {
+        char* slab = static_cast<char*>(pool_backend_alloc(pool, POOL_SLAB_BYTES));
+        if (nullptr == slab) return nullptr;
+        pool->slabs.push_back(slab);
+        for (size_t offset = POOL_SLAB_BYTES - size_class; offset > 0; offset -= size_class) {
+            pool->block_class[slab + offset] = size_class;
+            free_list.push_back(slab + offset);
+        }
+        pool->block_class[slab] = size_class;
+        return slab;
+    }
+    void* p = pool_backend_alloc(pool, size_class);
+    if (nullptr != p) pool->block_class[p] = size_class;
+    return p;
+}
+
+// Returns a buffer from pool_alloc to its free list.
+static inline void pool_free(staging_pool* pool, void* p) {
+    if (nullptr == p) return;
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    const auto it = pool->block_class.find(p);
+    if (pool->block_class.end() == it) {
+        fprintf(stderr, "ERROR: %p was not allocated from the staging pool\n", p);
+        return;
+    }
+    pool->free_blocks[it->second].push_back(p);
+}
+
+// Releases the cached large blocks to the backend. Slabs stay, they are small.
+static inline void pool_trim(staging_pool* pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (auto& entry : pool->free_blocks) {
+        if (entry.first <= POOL_SLAB_CLASS_BYTES) continue;
+        for (void* p : entry.second) {
+            pool->block_class.erase(p);
+            pool->backend_free(p);
+        }
+        entry.second.clear();
+    }
+}
+
+// Releases all memory of the pool, including buffers that were not returned.
+static inline void pool_destroy(staging_pool* pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (const auto& entry : pool->block_class)
+        if (entry.second > POOL_SLAB_CLASS_BYTES) pool->backend_free(entry.first);
+    for (void* slab : pool->slabs) pool->backend_free(slab);
+    pool->block_class.clear();
+    pool->free_blocks.clear();
+    pool->slabs.clear();
+}
+
+#endif  // JACOBI_POOL_H
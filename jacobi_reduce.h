@@ -0,0 +1,67 @@
+// Hierarchical reduction of the norm across domains.
+//
+// The norm is reduced in two levels. Within a domain the sweep sums the residues of its rows over
+// the SIMD lanes and threads of its team (jacobi_kernel). Across domains the partial sums combine
+// along a binary tree of sequence counters (jacobi_sync.h) instead of in one place: in round k a
+// domain d with d % 2^(k+1) == 0 adds the partial of domain d + 2^k as soon as that one published
+// it, every other domain hands its partial to its parent and leaves the tree. After
+// ceil(log2(N)) rounds domain 0 holds the sum and publishes it to all domains. Nobody sums or
+// waits for all N partials: a domain waits for at most log2(N) children and the result, and no
+// thread has to join all domains first (the single thread of the host solve after a barrier, or
+// every domain reading every other's partial in -p2p). The partials are added in the same order
+// on every check, whatever the timing, so the norm and the iteration a solve stops at are
+// reproducible.
+#ifndef JACOBI_REDUCE_H
+#define JACOBI_REDUCE_H
+
+#include <vector>
+
+#include "jacobi_domain.h"
+#include "jacobi_sync.h"
+
+struct norm_tree_node {
+    seq_flag ready;  // Number of the last check whose partial is in partial
+    real partial = 0.0;
+};
+
+struct norm_tree {
+    int num_domains = 0;
+    std::vector<norm_tree_node> nodes;  // One per domain
+    seq_flag done;                      // Number of the last check whose sum is in total
+    padded<real> total;
+};
+
+static void norm_tree_init(norm_tree* tree, const int num_domains) {
+    tree->num_domains = num_domains;
+    tree->nodes = std::vector<norm_tree_node>(num_domains);
+}
+
+// Adds partial, the norm of domain dev_id, to check seq (1, 2, ... in every domain) and returns the
+// sum over all domains. Every domain has to call it for every check.
+static real norm_tree_reduce(norm_tree* tree, const int dev_id, const uint32_t seq,
+                             const real partial, const int spins = SEQ_FLAG_SPINS) {
+    real sum = partial;
+    for (int stride = 1; stride < tree->num_domains; stride *= 2) {
+        if (dev_id % (2 * stride)) {
+            // The parent reads the partial before it publishes the sum of seq, which this domain
+            // waits for, so the partial of seq + 1 cannot overwrite it
+            tree->nodes[dev_id].partial = sum;
+            seq_flag_publish(&tree->nodes[dev_id].ready, seq);
+            break;
+        }
+        const int child = dev_id + stride;
+        if (child < tree->num_domains) {
+            seq_flag_wait(&tree->nodes[child].ready, seq, spins);
+            sum += tree->nodes[child].partial;
+        }
+    }
+    if (0 == dev_id) {
+        tree->total.value = sum;
+        seq_flag_publish(&tree->done, seq);
+        return sum;
+    }
+    seq_flag_wait(&tree->done, seq, spins);
+    return tree->total.value;
+}
+
+#endif  // JACOBI_REDUCE_H
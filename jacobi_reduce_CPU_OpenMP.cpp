@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_reduce.h"
+
+// Norm reduction benchmark: latency of one norm check across 1 to -maxdomains domains (256 by
+// default, doubling) with the three reductions the host driver used or uses. A domain is a
+// thread, a check the reduction of one partial per domain to a sum every domain holds:
+//   host  every domain writes its partial, a barrier, one thread sums all partials, a barrier
+//         (the host solve before jacobi_reduce.h)
+//   all   every domain publishes its partial and sums the partials of all domains once they are
+//         published (-p2p before jacobi_reduce.h)
+//   tree  norm_tree_reduce() of jacobi_reduce.h
+// The latency is the time of a check, averaged over -niter checks after a tenth as many untimed
+// ones. Every check is verified: domain d adds d + 1, so every domain has to get N (N + 1) / 2,
+// which a real holds exactly for these counts.
+
+constexpr const char* reduce_method_names[] = {"host", "all", "tree"};
+enum reduce_method { REDUCE_HOST, REDUCE_ALL, REDUCE_TREE };
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+// Runs warmup untimed and checks timed reductions of method across num_domains threads. Returns
+// the time per check, or a negative value if a domain got a wrong sum.
+static double run_checks(const reduce_method method, const int num_domains, const int warmup,
+                         const int checks) {
+    const int spins = num_domains > omp_get_num_procs() ? 0 : SEQ_FLAG_SPINS;
+    const real expected = real(num_domains) * (num_domains + 1) / 2;
+    std::vector<padded<real>> partials(num_domains);
+    real host_sum = 0.0;
+    // all: the slots of odd and even checks alternate, a domain still reading the slots of one
+    // check cannot see them overwritten by the next
+    std::vector<seq_flag> published(num_domains);
+    std::vector<padded<real>> slots(2 * num_domains);
+    norm_tree tree;
+    norm_tree_init(&tree, num_domains);
+
+    double seconds = 0.0;
+    bool correct = true;
+#pragma omp parallel num_threads(num_domains) reduction(&& : correct)
+    {
+        const int dev_id = omp_get_thread_num();
+        const real partial = real(dev_id + 1);
+        double start = 0.0;
+        for (uint32_t check = 1; check <= uint32_t(warmup + checks); ++check) {
+            if (check == uint32_t(warmup + 1)) {
+#pragma omp barrier
+                start = omp_get_wtime();
+            }
+            real sum = 0.0;
+            if (REDUCE_HOST == method) {
+                partials[dev_id].value = partial;
+#pragma omp barrier
+#pragma omp single
+                {
+                    host_sum = 0.0;
+                    for (int other = 0; other < num_domains; ++other)
+                        host_sum += partials[other].value;
+                }
+                sum = host_sum;
+            } else if (REDUCE_ALL == method) {
+                padded<real>* const check_slots = slots.data() + (check % 2) * num_domains;
+                check_slots[dev_id].value = partial;
+                seq_flag_publish(&published[dev_id], check);
+                for (int other = 0; other < num_domains; ++other) {
+                    seq_flag_wait(&published[other], check, spins);
+                    sum += check_slots[other].value;
+                }
+            } else {
+                sum = norm_tree_reduce(&tree, dev_id, check, partial, spins);
+            }
+            correct = correct && sum == expected;
+        }
+        // The domain that finishes last ends the timed checks
+#pragma omp barrier
+        if (0 == dev_id) seconds = (omp_get_wtime() - start) / checks;
+    }
+    return correct ? seconds : -1.0;
+}
+
+int main(int argc, char* argv[]) {
+    const int max_domains = get_argval<int>(argv, argv + argc, "-maxdomains", 256);
+    const int checks = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    const std::string methods =
+        get_argval<std::string>(argv, argv + argc, "-method", "host,all,tree");
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+
+    std::vector<reduce_method> selected;
+    std::istringstream list(methods);
+    for (std::string name; std::getline(list, name, ',');) {
+        const char* const* found =
+            std::find_if(std::begin(reduce_method_names), std::end(reduce_method_names),
+                         [&](const char* method) { return name == method; });
+        if (std::end(reduce_method_names) == found) {
+            fprintf(stderr, "ERROR: -method must list host, all or tree\n");
+            return -1;
+        }
+        selected.push_back(reduce_method(found - std::begin(reduce_method_names)));
+    }
+    if (max_domains < 1 || checks < 1) {
+        fprintf(stderr, "ERROR: -maxdomains and -niter must be at least 1\n");
+        return -1;
+    }
+    omp_set_dynamic(0);
+
+    if (csv)
+        printf("norm_reduce, method, domains, latency_us\n");
+    else
+        printf("%-8s %8s %12s\n", "method", "domains", "latency us");
+
+    int result_correct = 1;
+    for (const reduce_method method : selected) {
+        for (int num_domains = 1; num_domains <= max_domains; num_domains *= 2) {
+            const double seconds = run_checks(method, num_domains, checks / 10, checks);
+            if (seconds < 0.0) {
+                fprintf(stderr, "ERROR: %s reduction across %d domains returned a wrong sum\n",
+                        reduce_method_names[method], num_domains);
+                result_correct = 0;
+                continue;
+            }
+            if (csv)
+                printf("norm_reduce, %s, %d, %f\n", reduce_method_names[method], num_domains,
+                       seconds * 1.0e6);
+            else
+                printf("%-8s %8d %12.2f\n", reduce_method_names[method], num_domains,
+                       seconds * 1.0e6);
+            fflush(stdout);
+        }
+    }
+    return result_correct ? 0 : 1;
+}
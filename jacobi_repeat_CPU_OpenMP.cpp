@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_solver.h"
+
+// Repeated solves through the embeddable solver API (jacobi_solver.h), as a simulation service
+// calling the solver many times in one process would do. Every solve is timed in two parts,
+// setup() and solve(), so the one-time cost of the first solve (allocation, page faults, thread
+// creation and pinning) can be compared with the steady state of the later ones. With -warm every
+// solve after the first continues from the previous result instead of calling setup().
+
+template <typename T>
+T get_argval(char** begin, char** end, const std::string& arg, const T default_val) {
+    T argval = default_val;
+    char** itr = std::find(begin, end, arg);
+    if (itr != end && ++itr != end) {
+        std::istringstream inbuf(*itr);
+        inbuf >> argval;
+    }
+    return argval;
+}
+
+bool get_arg(char** begin, char** end, const std::string& arg) {
+    char** itr = std::find(begin, end, arg);
+    if (itr != end) {
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    const int iter_max = get_argval<int>(argv, argv + argc, "-niter", 1000);
+    const int nx = get_argval<int>(argv, argv + argc, "-nx", 1024);
+    const int ny = get_argval<int>(argv, argv + argc, "-ny", 1024);
+    const int num_solves = get_argval<int>(argv, argv + argc, "-nsolves", 10);
+    const std::string affinity_name =
+        get_argval<std::string>(argv, argv + argc, "-affinity", "none");
+    const std::string hugepages_name =
+        get_argval<std::string>(argv, argv + argc, "-hugepages", "none");
+    const bool warm = get_arg(argv, argv + argc, "-warm");
+    const bool csv = get_arg(argv, argv + argc, "-csv");
+
+    solver_options options;
+    options.num_domains = get_argval<int>(argv, argv + argc, "-ndomains", 1);
+    options.num_threads = get_argval<int>(argv, argv + argc, "-nthreads", 1);
+    options.block_x = get_argval<int>(argv, argv + argc, "-blockx", 0);
+    options.block_y = get_argval<int>(argv, argv + argc, "-blocky", 0);
+    options.nccheck = get_argval<int>(argv, argv + argc, "-nccheck", 1);
+    if (!numa_parse_policy(affinity_name, &options.affinity)) {
+        fprintf(stderr, "ERROR: -affinity must be one of none, compact, scatter or numa\n");
+        return -1;
+    }
+    if (!hugepage_parse_policy(hugepages_name, &options.hugepages)) {
+        fprintf(stderr, "ERROR: -hugepages must be one of none, thp, 2m or 1g\n");
+        return -1;
+    }
+    if (num_solves < 1 || options.nccheck < 1) {
+        fprintf(stderr, "ERROR: -nsolves and -nccheck must be at least 1\n");
+        return -1;
+    }
+
+    omp_set_dynamic(0);
+
+    Solver solver(options);
+    std::vector<double> setup_time(num_solves, 0.0);
+    std::vector<double> solve_time(num_solves);
+    int iter = 0;
+    real l2_norm = 0.0;
+    for (int s = 0; s < num_solves; ++s) {
+        const double start = omp_get_wtime();
+        if ((0 == s || !warm) && !solver.setup(nx, ny)) {
+            fprintf(stderr, "ERROR: cannot set up a %d x %d grid with %d domains\n", nx, ny,
+                    options.num_domains);
+            return -1;
+        }
+        const double setup_done = omp_get_wtime();
+        iter = solver.solve(iter_max, tol, &l2_norm);
+        const double stop = omp_get_wtime();
+        setup_time[s] = setup_done - start;
+        solve_time[s] = stop - setup_done;
+        if (!csv)
+            printf("solve %3d: setup %8.4f s, solve %8.4f s, %d iterations, norm %0.6f\n", s,
+                   setup_time[s], solve_time[s], iter, l2_norm);
+    }
+
+    double setup_rest = 0.0;
+    double solve_rest = 0.0;
+    for (int s = 1; s < num_solves; ++s) {
+        setup_rest += setup_time[s];
+        solve_rest += solve_time[s];
+    }
+    if (num_solves > 1) {
+        setup_rest /= num_solves - 1;
+        solve_rest /= num_solves - 1;
+    }
+
+    if (csv) {
+        printf("repeat_cpu, %d, %d, %d, %d, %d, %d, %f, %f, %f, %f, %d\n", nx, ny, iter_max,
+               num_solves, options.num_domains, options.num_threads, setup_time[0],
+               solve_time[0], setup_rest, solve_rest, warm ? 1 : 0);
+    } else {
+        printf("Num domains: %d (%d threads each).\n", options.num_domains, options.num_threads);
+        printf("%dx%d: first solve: setup %8.4f s, solve %8.4f s\n", ny, nx, setup_time[0],
+               solve_time[0]);
+        if (num_solves > 1)
+            printf("%dx%d: later solves (%s): setup %8.4f s, solve %8.4f s (mean of %d)\n", ny, nx,
+                   warm ? "warm" : "cold", setup_rest, solve_rest, num_solves - 1);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+// POSIX shared memory segments for the halo exchange between processes on one node.
+//
+// Every process keeps the grids of its domain in a segment of its own (shm_open + mmap), headed by
+// a control area for the synchronisation state of the halo exchange (the mailboxes of the shm
+// transport, jacobi_transport.h), and maps the segments of its top and bottom neighbour. A
+// neighbour then writes its new boundary row straight into the halo row of the grid the domain
+// reads next and signals it through the control area, like the pushes between the domains of the
+// -p2p solve: no staging buffers, no messages and no second copy on the receiving side. Segments
+// are named by the creator and unlinked once all neighbours mapped them, so nothing is left
+// behind in /dev/shm when a process dies.
+#ifndef JACOBI_SHM_H
+#define JACOBI_SHM_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "jacobi_cpu.h"
+
+// The grids start on the page after the control area, so that they are page aligned like the
+// grids of hugepage_alloc() and first touch places them page by page
+constexpr size_t SHM_PAGE_BYTES = 4096;
+
+struct shm_domain {
+    std::string name;
+    size_t bytes = 0;
+    void* base = nullptr;
+    char* control = nullptr;              // Control area at the start of the segment
+    real* grids[2] = {nullptr, nullptr};  // a and a_new, rows * pitch elements each
+};
+
+static size_t shm_control_bytes(const size_t control_bytes) {
+    return (control_bytes + SHM_PAGE_BYTES - 1) / SHM_PAGE_BYTES * SHM_PAGE_BYTES;
+}
+
+static bool shm_map(shm_domain* domain, const std::string& name, const size_t control_bytes,
+                    const int rows, const int pitch, const bool create) {
+    domain->name = name;
+    domain->bytes = shm_control_bytes(control_bytes) + 2 * size_t(rows) * pitch * sizeof(real);
+    const int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: shm_open of %s failed: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+    if (create && ftruncate(fd, domain->bytes) != 0) {
+        fprintf(stderr, "ERROR: ftruncate of %s failed: %s\n", name.c_str(), strerror(errno));
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* const base = mmap(nullptr, domain->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == base) {
+        fprintf(stderr, "ERROR: mmap of %s failed: %s\n", name.c_str(), strerror(errno));
+        if (create) shm_unlink(name.c_str());
+        return false;
+    }
+    domain->base = base;
+    domain->control = static_cast<char*>(base);
+    domain->grids[0] = reinterpret_cast<real*>(domain->control + shm_control_bytes(control_bytes));
+    domain->grids[1] = domain->grids[0] + size_t(rows) * pitch;
+    return true;
+}
+
+// Creates and maps the segment name with a control area of control_bytes and the grids of a
+// domain of rows rows (halo rows included). Everything is zero (ftruncate) and not touched yet.
+static bool shm_create(shm_domain* domain, const std::string& name, const size_t control_bytes,
+                       const int rows, const int pitch) {
+    return shm_map(domain, name, control_bytes, rows, pitch, true);
+}
+
+// Maps the segment of another process, created with the same sizes
+static bool shm_attach(shm_domain* domain, const std::string& name, const size_t control_bytes,
+                       const int rows, const int pitch) {
+    return shm_map(domain, name, control_bytes, rows, pitch, false);
+}
+
+// Removes the name of a created segment; the mappings stay valid
+static void shm_unlink_domain(const shm_domain& domain) { shm_unlink(domain.name.c_str()); }
+
+static void shm_detach(shm_domain* domain) {
+    if (domain->base) munmap(domain->base, domain->bytes);
+    domain->base = nullptr;
+    domain->control = nullptr;
+    domain->grids[0] = domain->grids[1] = nullptr;
+}
+
+#endif  // JACOBI_SHM_H
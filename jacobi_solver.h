@@ -0,0 +1,227 @@
+// Embeddable host Jacobi solver for repeated solves in a long-running process.
+//
+//     Solver solver(options);
+//     solver.setup(nx, ny);                  // allocate, place and initialise the domains
+//     int iters = solver.solve(1000);        // iterate until converged or 1000 iterations
+//     solver.get_field(field);               // dense nx * ny copy of the result
+//     iters = solver.solve(1000);            // warm start: continue from the current field
+//     solver.set_field(guess);               // or start from an initial guess
+//
+// The decomposition is that of jacobi_multi_CPU_OpenMP.cpp: num_domains domains of rows, each
+// swept by a team of num_threads threads, with the periodic halo rows pushed with memcpy. The
+// domain grids, the thread pinning and the OpenMP thread pool are kept across solves, and setup()
+// with an unchanged grid size only resets the field, so the cost of a solve after the first one
+// is the iterations.
+#ifndef JACOBI_SOLVER_H
+#define JACOBI_SOLVER_H
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <omp.h>
+
+#include "jacobi_cpu.h"
+#include "jacobi_hugepage.h"
+#include "jacobi_numa.h"
+#include "jacobi_pitch.h"
+
+struct solver_options {
+    int num_domains = 1;
+    int num_threads = 1;  // Threads per domain
+    int block_x = 0;      // Block shape of jacobi_kernel, 0 = default
+    int block_y = 0;
+    int nccheck = 1;  // Norm check interval
+    numa_policy affinity = NUMA_AFFINITY_NONE;
+    hugepage_policy hugepages = HUGEPAGE_NONE;
+};
+
+class Solver {
+  public:
+    explicit Solver(const solver_options& options = solver_options()) : options_(options) {}
+    ~Solver() { release(); }
+    Solver(const Solver&) = delete;
+    Solver& operator=(const Solver&) = delete;
+
+    // Prepares an nx x ny problem: zero initial guess with the Dirichlet boundary conditions
+    // sin(2 pi y / (ny - 1)) on the left and right border. Buffers are reallocated only if the
+    // grid size changed. Returns false if the options are not valid or the grid cannot be
+    // decomposed or allocated.
+    bool setup(const int nx, const int ny) {
+        if (nx < 3 || ny < 3 || options_.num_domains < 1 || options_.num_domains > ny - 2 ||
+            options_.num_threads < 1 || options_.nccheck < 1)
+            return false;
+        if (options_.num_threads > 1 && omp_get_max_active_levels() < 2)
+            omp_set_max_active_levels(2);
+        if (nx != nx_ || ny != ny_) {
+            release();
+            if (!allocate(nx, ny)) {
+                release();
+                return false;
+            }
+        }
+        const int num_domains = options_.num_domains;
+#pragma omp parallel num_threads(num_domains)
+        {
+            const int dev_id = omp_get_thread_num();
+            domain& d = domains_[dev_id];
+            const cpu_set_t* const team_affinity = affinity(dev_id);
+            first_touch(d.a, iy_start, d.iy_end, nx_, pitch_, options_.num_threads,
+                        options_.block_x, options_.block_y, team_affinity);
+            first_touch(d.a_new, iy_start, d.iy_end, nx_, pitch_, options_.num_threads,
+                        options_.block_x, options_.block_y, team_affinity);
+            initialize_boundaries(d.a_new, d.a, PI, d.iy_start_global - 1, nx_, pitch_,
+                                  d.iy_end + 1, ny_);
+        }
+        return true;
+    }
+
+    // Replaces the interior of the current field with the dense nx * ny array field (the
+    // boundary columns stay), e.g. an initial guess from a previous or a coarser solve.
+    void set_field(const real* const field) {
+        for (domain& d : domains_)
+            for (int iy = iy_start; iy < d.iy_end; ++iy)
+                std::memcpy(d.a + iy * pitch_ + 1, field + (d.iy_start_global - 1 + iy) * nx_ + 1,
+                            (nx_ - 2) * sizeof(real));
+        const int num_domains = options_.num_domains;
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id)
+            push_halos(dev_id, [](domain& other) { return other.a; });
+    }
+
+    // Replaces the left and right boundary columns with the ny values each of left and right,
+    // e.g. the Dirichlet borders of a grid of jacobi_batch.h.
+    void set_boundaries(const real* const left, const real* const right) {
+        for (domain& d : domains_) {
+            for (int iy = 0; iy <= d.iy_end; ++iy) {
+                const int iy_global = d.iy_start_global - 1 + iy;
+                d.a[iy * pitch_ + 0] = d.a_new[iy * pitch_ + 0] = left[iy_global];
+                d.a[iy * pitch_ + (nx_ - 1)] = d.a_new[iy * pitch_ + (nx_ - 1)] = right[iy_global];
+            }
+        }
+    }
+
+    // Iterates from the current field until the L2 norm of the update is at most tolerance
+    // (checked every nccheck iterations) or iter_max iterations are done. Returns the number of
+    // iterations, *l2_norm_out (if not null) is set to the last computed norm.
+    int solve(const int iter_max, const real tolerance = tol, real* const l2_norm_out = nullptr) {
+        const int num_domains = options_.num_domains;
+        const int nccheck = options_.nccheck;
+        if (domains_.empty() || nccheck < 1) return 0;
+        int iter = 0;
+        real l2_norm = 1.0;
+#pragma omp parallel num_threads(num_domains)
+        {
+            const int dev_id = omp_get_thread_num();
+            domain& d = domains_[dev_id];
+            const cpu_set_t* const team_affinity = affinity(dev_id);
+            while (l2_norm > tolerance && iter < iter_max) {
+                const bool calculate_norm = (iter % nccheck) == 0;
+                d.l2_norm = jacobi_kernel(d.a_new, d.a, iy_start, d.iy_end, nx_, pitch_,
+                                          options_.num_threads, options_.block_x,
+                                          options_.block_y, team_affinity, calculate_norm);
+
+                // Apply periodic boundary conditions
+                push_halos(dev_id, [](domain& other) { return other.a_new; });
+#pragma omp barrier
+#pragma omp single
+                {
+                    if (calculate_norm) {
+                        l2_norm = 0.0;
+                        for (const domain& other : domains_) l2_norm += other.l2_norm;
+                        l2_norm = std::sqrt(l2_norm);
+                    }
+                    for (domain& other : domains_) std::swap(other.a_new, other.a);
+                    iter++;
+                }
+            }
+        }
+        if (l2_norm_out) *l2_norm_out = l2_norm;
+        return iter;
+    }
+
+    // Copies the current field, including the boundary columns and the periodic halo rows, into
+    // the dense nx * ny array field.
+    void get_field(real* const field) const {
+        std::memcpy(field, domains_.front().a, nx_ * sizeof(real));
+        for (const domain& d : domains_)
+            for (int iy = iy_start; iy <= d.iy_end; ++iy)
+                std::memcpy(field + (d.iy_start_global - 1 + iy) * nx_, d.a + iy * pitch_,
+                            nx_ * sizeof(real));
+    }
+
+    int nx() const { return nx_; }
+    int ny() const { return ny_; }
+
+  private:
+    static constexpr int iy_start = 1;
+
+    struct domain {
+        real* a = nullptr;
+        real* a_new = nullptr;
+        int iy_start_global = 0;  // Start index of the domain in the global array
+        int iy_end = 0;
+        real l2_norm = 0.0;
+    };
+
+    bool allocate(const int nx, const int ny) {
+        const int num_domains = options_.num_domains;
+        nx_ = nx;
+        ny_ = ny;
+        pitch_ = row_pitch(nx, sizeof(real));
+        domains_.resize(num_domains);
+        // Same decomposition as the drivers: chunk_size_low or chunk_size_low + 1 rows each
+        const int chunk_size_low = (ny - 2) / num_domains;
+        const int num_ranks_low = num_domains * chunk_size_low + num_domains - (ny - 2);
+        for (int dev_id = 0; dev_id < num_domains; ++dev_id) {
+            domain& d = domains_[dev_id];
+            const int chunk_size = chunk_size_low + (dev_id < num_ranks_low ? 0 : 1);
+            d.iy_start_global =
+                dev_id * chunk_size_low + std::max(0, dev_id - num_ranks_low) + 1;
+            d.iy_end = iy_start + chunk_size;
+            const size_t bytes = pitch_ * (chunk_size + 2) * sizeof(real);
+            d.a = (real*)hugepage_alloc(bytes, options_.hugepages);
+            d.a_new = (real*)hugepage_alloc(bytes, options_.hugepages);
+            if (nullptr == d.a || nullptr == d.a_new) return false;
+        }
+        affinity_ = numa_affinity_masks(numa_discover(), options_.affinity, num_domains,
+                                        options_.num_threads);
+        return true;
+    }
+
+    void release() {
+        for (domain& d : domains_) {
+            hugepage_free(d.a_new);
+            hugepage_free(d.a);
+        }
+        domains_.clear();
+        nx_ = 0;
+        ny_ = 0;
+    }
+
+    const cpu_set_t* affinity(const int dev_id) const {
+        return affinity_.empty() ? nullptr : &affinity_[dev_id * options_.num_threads];
+    }
+
+    // Pushes the first and last row of domain dev_id into the halo rows of its neighbours, in
+    // the grid grid(domain) of every domain.
+    template <typename F>
+    void push_halos(const int dev_id, F grid) {
+        const int num_domains = options_.num_domains;
+        const int top = dev_id > 0 ? dev_id - 1 : (num_domains - 1);
+        const int bottom = (dev_id + 1) % num_domains;
+        domain& d = domains_[dev_id];
+        std::memcpy(grid(domains_[top]) + domains_[top].iy_end * pitch_,
+                    grid(d) + iy_start * pitch_, nx_ * sizeof(real));
+        std::memcpy(grid(domains_[bottom]), grid(d) + (d.iy_end - 1) * pitch_,
+                    nx_ * sizeof(real));
+    }
+
+    solver_options options_;
+    int nx_ = 0;
+    int ny_ = 0;
+    int pitch_ = 0;
+    std::vector<domain> domains_;
+    std::vector<cpu_set_t> affinity_;
+};
+
+#endif  // JACOBI_SOLVER_H
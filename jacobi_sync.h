@@ -0,0 +1,75 @@
+// Point to point synchronisation between domains with sequence counters.
+//
+// A seq_flag is a counter on its own cache line that one producer advances with
+// seq_flag_publish() (a release store) after it has written the data the counter guards, and
+// consumers wait with seq_flag_wait() until it reaches the sequence number they need (acquire
+// loads). Waiting spins for SEQ_FLAG_SPINS polls first, which covers a neighbour that is a few
+// microseconds behind, and then sleeps in futex(FUTEX_WAIT) until the producer wakes it, so
+// oversubscribed or badly imbalanced domains do not burn the CPU their neighbour needs. The
+// producer only makes the wake system call if a consumer registered as sleeping. Flags in memory
+// shared between processes (jacobi_shm.h) set process_shared, which selects the shared futex
+// operations instead of the cheaper private ones.
+#ifndef JACOBI_SYNC_H
+#define JACOBI_SYNC_H
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEQ_FLAG_PAUSE() _mm_pause()
+#else
+#define SEQ_FLAG_PAUSE() std::atomic_signal_fence(std::memory_order_seq_cst)
+#endif
+
+constexpr int SEQ_FLAG_SPINS = 4000;
+
+struct alignas(64) seq_flag {
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> sleepers{0};
+    bool process_shared = false;
+};
+
+// Makes sequence number seq and everything written before visible to the waiters
+static inline void seq_flag_publish(seq_flag* flag, const uint32_t seq) {
+    // Sequentially consistent with the load of sleepers, so that either the producer sees a
+    // registered sleeper or the sleeper sees the new sequence number before it sleeps
+    flag->seq.store(seq, std::memory_order_seq_cst);
+    if (flag->sleepers.load(std::memory_order_seq_cst) > 0)
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&flag->seq),
+                flag->process_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr,
+                0);
+}
+
+// True if the sequence number of flag is at least seq, without waiting
+static inline bool seq_flag_test(seq_flag* flag, const uint32_t seq) {
+    return flag->seq.load(std::memory_order_acquire) >= seq;
+}
+
+// Returns once the sequence number of flag is at least seq, polling at most spins times before
+// sleeping. Oversubscribed callers should not spin (like the throttled spin of libgomp), the
+// producer they wait for may need their CPU.
+static inline void seq_flag_wait(seq_flag* flag, const uint32_t seq,
+                                 const int spins = SEQ_FLAG_SPINS) {
+    for (int spin = 0; spin < spins; ++spin) {
+        if (flag->seq.load(std::memory_order_acquire) >= seq) return;
+        SEQ_FLAG_PAUSE();
+    }
+    for (;;) {
+        flag->sleepers.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t current = flag->seq.load(std::memory_order_seq_cst);
+        if (current < seq)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&flag->seq),
+                    flag->process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, current, nullptr,
+                    nullptr, 0);
+        flag->sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if (flag->seq.load(std::memory_order_acquire) >= seq) return;
+    }
+}
+
+#endif  // JACOBI_SYNC_H
@@ -0,0 +1,342 @@
+// Host task graph runtime with the stream and event semantics of the GPU drivers.
+//
+// Operations are launched into in-order streams (host_stream) and run asynchronously on a work
+// stealing pool of worker threads (task_pool):
+//
+//     stream_wait_event(&compute_stream, &push_done);   // like cudaStreamWaitEvent
+//     stream_launch(&compute_stream, num_parts, [=](int part) { ... });   // like a kernel launch
+//     event_record(&compute_done, &compute_stream);     // like cudaEventRecord
+//     event_synchronize(&compute_done);                 // like cudaEventSynchronize
+//
+// Every operation is a node of a dependency graph: it depends on the previous operation of its
+// stream and on the events the stream waits for, and becomes ready when they have completed. A
+// ready operation with num_parts parts pushes one task per part into the pool, the host analogue
+// of the thread blocks of a kernel, and completes when its last part finishes. Workers pop tasks
+// from the back of their own deque and steal from the front of the others' when it runs empty, so
+// the parts spread over the idle workers and the successors of an operation start on the worker
+// that finished it. As for CUDA events, a wait refers to the last operation recorded before the
+// wait is issued, so an event can be recorded again right away. Nothing but the dependencies
+// orders the operations, there are no barriers.
+//
+// Like CUDA graphs, the operations launched between task_graph_begin() and task_graph_end() into
+// a set of streams are not run but recorded into a task_graph, whose nodes and edges are built
+// once and replayed any number of times with task_graph_launch(): a replay only rearms the
+// dependency counters of the nodes and pushes the roots, without allocating anything.
+#ifndef JACOBI_TASKGRAPH_H
+#define JACOBI_TASKGRAPH_H
+
+#include <sched.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "jacobi_numa.h"
+
+// Spins of an idle worker looking for work before it sleeps
+constexpr int TASK_POOL_IDLE_SPINS = 2000;
+
+struct task_node {
+    std::function<void(int)> fn;
+    int num_parts = 1;
+    int num_deps = 0;         // Dependencies of a graph node
+    bool persistent = false;  // Graph node: kept with its function and edges after completion
+    std::atomic<int> parts_left{0};
+    std::atomic<int> deps_left{1};  // Dependencies plus one held while they are added
+
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    std::vector<std::shared_ptr<task_node>> successors;
+};
+typedef std::shared_ptr<task_node> task_node_ptr;
+
+struct task_part {
+    task_node_ptr node;
+    int part;
+};
+
+struct task_worker {
+    std::mutex mutex;
+    std::deque<task_part> tasks;
+};
+
+struct task_pool {
+    std::vector<std::unique_ptr<task_worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<long> queued{0};  // Tasks in all deques
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned> next_worker{0};  // Round robin target of launches from other threads
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+};
+
+struct task_graph;
+
+struct host_stream {
+    task_pool* pool = nullptr;
+    task_node_ptr tail;                // Last operation launched into the stream
+    std::vector<task_node_ptr> waits;  // Events the next operation waits for
+    task_graph* capture = nullptr;     // Graph the stream records into, if capturing
+};
+
+struct task_graph {
+    task_pool* pool = nullptr;
+    std::vector<task_node_ptr> nodes;
+    task_node_ptr exit;  // Depends on every node without successors
+};
+
+struct host_event {
+    task_node_ptr node;  // Last recorded operation, empty if never recorded
+};
+
+static thread_local task_pool* task_local_pool = nullptr;
+static thread_local int task_local_worker = -1;
+
+static void task_push(task_pool* pool, const task_node_ptr& node) {
+    const int num_workers = pool->workers.size();
+    const bool own = task_local_pool == pool;
+    for (int part = 0; part < node->num_parts; ++part) {
+        // Workers keep the parts local, other threads spread them over the deques
+        const int w = own ? task_local_worker : int(pool->next_worker++ % num_workers);
+        task_worker& worker = *pool->workers[w];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back({node, part});
+    }
+    pool->queued.fetch_add(node->num_parts);
+    if (pool->sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+        if (node->num_parts > 1)
+            pool->sleep_cv.notify_all();
+        else
+            pool->sleep_cv.notify_one();
+    }
+}
+
+// Drops one dependency of node and pushes its parts once none is left
+static void task_release(task_pool* pool, const task_node_ptr& node) {
+    if (1 == node->deps_left.fetch_sub(1)) {
+        node->parts_left.store(node->num_parts);
+        task_push(pool, node);
+    }
+}
+
+static void task_depend(const task_node_ptr& node, const task_node_ptr& dependency) {
+    if (!dependency) return;
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->done) return;
+    node->deps_left.fetch_add(1);
+    dependency->successors.push_back(node);
+}
+
+static void task_complete(task_pool* pool, const task_node_ptr& node) {
+    if (node->persistent) {
+        // The edges of a graph node do not change after capture. Done is set first, the graph
+        // may be launched again as soon as the last successor is released.
+        {
+            std::lock_guard<std::mutex> lock(node->mutex);
+            node->done = true;
+            node->done_cv.notify_all();
+        }
+        for (const task_node_ptr& successor : node->successors) task_release(pool, successor);
+        return;
+    }
+    node->fn = nullptr;
+    std::vector<task_node_ptr> successors;
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->done = true;
+        successors.swap(node->successors);
+        node->done_cv.notify_all();
+    }
+    for (const task_node_ptr& successor : successors) task_release(pool, successor);
+}
+
+static bool task_pop(task_pool* pool, const int w, task_part* const task) {
+    const int num_workers = pool->workers.size();
+    for (int i = 0; i < num_workers; ++i) {
+        const int victim = (w + i) % num_workers;
+        task_worker& worker = *pool->workers[victim];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) continue;
+        // Own work last in first out, stolen work first in first out
+        if (0 == i) {
+            *task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            *task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        pool->queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+static void task_worker_loop(task_pool* pool, const int w, const cpu_set_t* const affinity) {
+    if (affinity) numa_bind_thread(affinity);
+    task_local_pool = pool;
+    task_local_worker = w;
+    task_part task;
+    int idle = 0;
+    while (!pool->stop.load(std::memory_order_relaxed)) {
+        if (pool->queued.load() > 0 && task_pop(pool, w, &task)) {
+            idle = 0;
+            task.node->fn(task.part);
+            if (1 == task.node->parts_left.fetch_sub(1)) task_complete(pool, task.node);
+            task.node.reset();
+        } else if (++idle < TASK_POOL_IDLE_SPINS) {
+            sched_yield();
+        } else {
+            std::unique_lock<std::mutex> lock(pool->sleep_mutex);
+            pool->sleepers.fetch_add(1);
+            pool->sleep_cv.wait(lock, [pool] { return pool->queued.load() > 0 || pool->stop; });
+            pool->sleepers.fetch_sub(1);
+            idle = 0;
+        }
+    }
+}
+
+// Starts num_workers worker threads; worker w is pinned to affinity[w] if affinity is not empty.
+static void task_pool_start(task_pool* pool, const int num_workers,
+                            const std::vector<cpu_set_t>& affinity) {
+    pool->stop = false;
+    for (int w = 0; w < num_workers; ++w) pool->workers.emplace_back(new task_worker);
+    for (int w = 0; w < num_workers; ++w)
+        pool->threads.emplace_back(task_worker_loop, pool, w,
+                                   affinity.empty() ? nullptr : &affinity[w]);
+}
+
+// Stops the workers; the launched operations must have completed.
+static void task_pool_stop(task_pool* pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+        pool->stop = true;
+        pool->sleep_cv.notify_all();
+    }
+    for (std::thread& thread : pool->threads) thread.join();
+    pool->threads.clear();
+    pool->workers.clear();
+}
+
+// Launches fn(part) for part in [0, num_parts) into stream, after the previous operation of the
+// stream and the events it waits for.
+static void stream_launch(host_stream* stream, const int num_parts, std::function<void(int)> fn) {
+    task_node_ptr node = std::make_shared<task_node>();
+    node->fn = std::move(fn);
+    node->num_parts = num_parts;
+    if (stream->capture) {
+        // Record the node and its edges, it runs when the graph is launched
+        node->persistent = true;
+        std::vector<task_node_ptr> dependencies = stream->waits;
+        if (stream->tail) dependencies.push_back(stream->tail);
+        for (const task_node_ptr& dependency : dependencies) {
+            dependency->successors.push_back(node);
+            ++node->num_deps;
+        }
+        stream->capture->nodes.push_back(node);
+        stream->waits.clear();
+        stream->tail = node;
+        return;
+    }
+    task_depend(node, stream->tail);
+    for (const task_node_ptr& wait : stream->waits) task_depend(node, wait);
+    stream->waits.clear();
+    stream->tail = node;
+    task_release(stream->pool, node);
+}
+
+// Records in event the point of stream after all operations launched so far
+static void event_record(host_event* event, host_stream* stream) {
+    // Pending waits belong to the recorded point, an empty operation takes them over
+    if (!stream->waits.empty()) stream_launch(stream, 1, [](int) {});
+    event->node = stream->tail;
+}
+
+// Makes the next operation launched into stream wait for the last record of event
+static void stream_wait_event(host_stream* stream, const host_event* event) {
+    if (event->node) stream->waits.push_back(event->node);
+}
+
+static void event_synchronize(const host_event* event) {
+    if (!event->node) return;
+    std::unique_lock<std::mutex> lock(event->node->mutex);
+    event->node->done_cv.wait(lock, [event] { return event->node->done; });
+}
+
+static void stream_synchronize(host_stream* stream) {
+    host_event event;
+    event_record(&event, stream);
+    event_synchronize(&event);
+}
+
+// Starts recording the operations launched into streams into graph. The streams must be idle;
+// their first operations in the graph depend on nothing but the graph launch.
+static void task_graph_begin(task_graph* graph, const std::vector<host_stream*>& streams) {
+    graph->pool = streams.front()->pool;
+    graph->nodes.clear();
+    for (host_stream* stream : streams) {
+        stream->tail.reset();
+        stream->waits.clear();
+        stream->capture = graph;
+    }
+}
+
+// Stops recording and completes graph with its exit node.
+static void task_graph_end(task_graph* graph, const std::vector<host_stream*>& streams) {
+    for (host_stream* stream : streams) {
+        stream->tail.reset();
+        stream->waits.clear();
+        stream->capture = nullptr;
+    }
+    graph->exit = std::make_shared<task_node>();
+    graph->exit->fn = [](int) {};
+    graph->exit->persistent = true;
+    for (const task_node_ptr& node : graph->nodes) {
+        if (node->successors.empty()) {
+            node->successors.push_back(graph->exit);
+            ++graph->exit->num_deps;
+        }
+    }
+    graph->nodes.push_back(graph->exit);
+}
+
+// Replays graph; the previous replay must have completed (task_graph_synchronize()).
+static void task_graph_launch(task_graph* graph) {
+    // Rearm every node before the first one can run, then drop the guard dependencies
+    for (const task_node_ptr& node : graph->nodes) {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->deps_left.store(node->num_deps + 1);
+        node->done = false;
+    }
+    for (const task_node_ptr& node : graph->nodes) task_release(graph->pool, node);
+}
+
+static void task_graph_synchronize(task_graph* graph) {
+    std::unique_lock<std::mutex> lock(graph->exit->mutex);
+    graph->exit->done_cv.wait(lock, [graph] { return graph->exit->done; });
+}
+
+// True if node to of a captured graph depends on node from, directly or through other nodes
+static inline bool task_graph_reaches(const task_node_ptr& from, const task_node_ptr& to) {
+    std::vector<const task_node*> pending = {from.get()};
+    std::unordered_set<const task_node*> visited;
+    while (!pending.empty()) {
+        const task_node* const node = pending.back();
+        pending.pop_back();
+        for (const task_node_ptr& successor : node->successors) {
+            if (successor == to) return true;
+            if (visited.insert(successor.get()).second) pending.push_back(successor.get());
+        }
+    }
+    return false;
+}
+
+#endif  // JACOBI_TASKGRAPH_H
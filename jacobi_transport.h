@@ -0,0 +1,339 @@
+// Halo exchange transports: the interface the solvers hand their halo rows to, and its
+// implementations.
+//
+// A halo_transport is the endpoint of one domain in a ring of domains that is periodic in y.
+// post_recv(edge, dst, count) posts the receive of the next halo row from the neighbour at edge,
+// post_send(edge, src, count) the send of a boundary row to it, and test() / wait() complete all
+// posted operations; src and dst must not be touched until then. At most one receive and one send
+// per edge are outstanding, and the receives of an exchange are posted before its sends, like
+// with MPI. Every transport runs in one of two modes:
+//   direct - the row goes straight from src into dst, which the sender learns from the posted
+//            receive (a rendezvous: a send completes once the receive is posted)
+//   packed - the row goes through a buffer per edge: the sender packs it and the receiver
+//            unpacks it when it completes the receive, so a send never waits for the receive
+// and one of three implementations:
+//   memcpy - domains in one process (threads), mailboxes in process memory
+//   shm    - processes on one node, mailboxes and grids in POSIX shared memory (jacobi_shm.h)
+//   mpi    - MPI_Isend / MPI_Irecv, compiled in if mpi.h is included before this header
+// memcpy and shm share the mailbox protocol: the mailbox of every edge has sequence counters
+// (jacobi_sync.h) of the posted receives, the delivered rows and the unpacked rows, and a direct
+// receive passes its destination as an offset into the region of the receiver, which the sender
+// maps at its own address. The copy of a send is made as soon as the receiver is ready, in
+// post_send() if it already is, otherwise in test() or wait().
+#ifndef JACOBI_TRANSPORT_H
+#define JACOBI_TRANSPORT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "jacobi_cpu.h"
+#include "jacobi_shm.h"
+#include "jacobi_sync.h"
+
+enum halo_edge { HALO_TOP = 0, HALO_BOTTOM = 1 };
+enum halo_mode { HALO_DIRECT = 0, HALO_PACKED };
+enum halo_kind { HALO_MEMCPY = 0, HALO_SHM, HALO_MPI };
+
+static const char* const halo_kind_names[] = {"memcpy", "shm", "mpi"};
+static const char* const halo_mode_names[] = {"direct", "packed"};
+
+static inline bool halo_parse_kind(const std::string& name, halo_kind* const kind) {
+    for (int k = HALO_MEMCPY; k <= HALO_MPI; ++k) {
+        if (name == halo_kind_names[k]) {
+            *kind = halo_kind(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline halo_edge halo_opposite(const halo_edge edge) {
+    return HALO_TOP == edge ? HALO_BOTTOM : HALO_TOP;
+}
+
+class halo_transport {
+  public:
+    virtual ~halo_transport() {}
+    virtual void post_recv(halo_edge edge, real* dst, int count) = 0;
+    virtual void post_send(halo_edge edge, const real* src, int count) = 0;
+    // True if all posted operations completed
+    virtual bool test() = 0;
+    virtual void wait() = 0;
+    virtual halo_kind kind() const = 0;
+    virtual halo_mode mode() const = 0;
+};
+
+// Mailbox of the rows arriving at one edge of a domain, followed by the packed buffer
+struct halo_mailbox {
+    seq_flag posted;               // Receives posted by the receiver
+    seq_flag sent;                 // Rows delivered by the sender
+    seq_flag unpacked;             // Packed rows copied out by the receiver
+    alignas(64) uint64_t dst = 0;  // Offset of the posted direct receive in the receiver's region
+
+    real* buffer() { return reinterpret_cast<real*>(this + 1); }
+};
+
+// Bytes of a mailbox with a packed buffer of capacity elements
+static inline size_t halo_mailbox_bytes(const int capacity) {
+    return sizeof(halo_mailbox) + (capacity * sizeof(real) + 63) / 64 * 64;
+}
+
+static inline halo_mailbox* halo_mailbox_init(void* const p, const bool process_shared) {
+    halo_mailbox* const mailbox = new (p) halo_mailbox();
+    for (seq_flag* flag : {&mailbox->posted, &mailbox->sent, &mailbox->unpacked})
+        flag->process_shared = process_shared;
+    return mailbox;
+}
+
+class mailbox_transport : public halo_transport {
+  public:
+    // in[edge] receives the rows arriving at edge, out[edge] is the mailbox of the neighbour at
+    // edge that the rows sent over edge go to. Direct receives are passed as offsets from
+    // own_region, which the neighbour at edge maps at peer_region[edge]. storage keeps the
+    // memory of the mailboxes alive.
+    mailbox_transport(const halo_kind kind, const halo_mode mode, halo_mailbox* const in[2],
+                      halo_mailbox* const out[2], const char* const own_region,
+                      char* const peer_region[2], const int spins,
+                      std::shared_ptr<void> storage = nullptr)
+        : kind_(kind), mode_(mode), own_region_(own_region), spins_(spins), storage_(storage) {
+        for (int edge = 0; edge < 2; ++edge) {
+            in_[edge] = in[edge];
+            out_[edge] = out[edge];
+            peer_region_[edge] = peer_region[edge];
+        }
+    }
+
+    void post_recv(const halo_edge edge, real* const dst, const int count) override {
+        recv_[edge] = {dst, nullptr, count, ++num_recvs_[edge], true};
+        if (HALO_DIRECT == mode_) {
+            in_[edge]->dst =
+                reinterpret_cast<uintptr_t>(dst) - reinterpret_cast<uintptr_t>(own_region_);
+            seq_flag_publish(&in_[edge]->posted, num_recvs_[edge]);
+        }
+        progress(false);
+    }
+
+    void post_send(const halo_edge edge, const real* const src, const int count) override {
+        send_[edge] = {nullptr, src, count, ++num_sends_[edge], true};
+        progress(false);
+    }
+
+    bool test() override { return progress(false); }
+    void wait() override { progress(true); }
+    halo_kind kind() const override { return kind_; }
+    halo_mode mode() const override { return mode_; }
+
+  private:
+    struct operation {
+        real* dst;
+        const real* src;
+        int count;
+        uint32_t seq;
+        bool active;
+    };
+
+    // True once the flag reached seq; waits for it if block
+    bool ready(seq_flag* const flag, const uint32_t seq, const bool block) {
+        if (seq_flag_test(flag, seq)) return true;
+        if (!block) return false;
+        seq_flag_wait(flag, seq, spins_);
+        return true;
+    }
+
+    // Completes what can be completed, all posted operations if block. Sends first, so that two
+    // domains waiting for each other's rows both deliver theirs before they wait.
+    bool progress(const bool block) {
+        bool done = true;
+        for (int edge = 0; edge < 2; ++edge) {
+            operation& send = send_[edge];
+            if (!send.active) continue;
+            halo_mailbox* const mailbox = out_[edge];
+            if (HALO_DIRECT == mode_) {
+                if (!ready(&mailbox->posted, send.seq, block)) {
+                    done = false;
+                    continue;
+                }
+                void* const dst = reinterpret_cast<void*>(
+                    reinterpret_cast<uintptr_t>(peer_region_[edge]) + mailbox->dst);
+                std::memcpy(dst, send.src, send.count * sizeof(real));
+            } else {
+                // The previous row has to be unpacked before the buffer is reused
+                if (!ready(&mailbox->unpacked, send.seq - 1, block)) {
+                    done = false;
+                    continue;
+                }
+                std::memcpy(mailbox->buffer(), send.src, send.count * sizeof(real));
+            }
+            seq_flag_publish(&mailbox->sent, send.seq);
+            send.active = false;
+        }
+        for (int edge = 0; edge < 2; ++edge) {
+            operation& recv = recv_[edge];
+            if (!recv.active) continue;
+            halo_mailbox* const mailbox = in_[edge];
+            if (!ready(&mailbox->sent, recv.seq, block)) {
+                done = false;
+                continue;
+            }
+            if (HALO_PACKED == mode_) {
+                std::memcpy(recv.dst, mailbox->buffer(), recv.count * sizeof(real));
+                seq_flag_publish(&mailbox->unpacked, recv.seq);
+            }
+            recv.active = false;
+        }
+        return done;
+    }
+
+    const halo_kind kind_;
+    const halo_mode mode_;
+    halo_mailbox* in_[2];
+    halo_mailbox* out_[2];
+    const char* const own_region_;
+    char* peer_region_[2];
+    const int spins_;
+    std::shared_ptr<void> storage_;
+    operation recv_[2] = {};
+    operation send_[2] = {};
+    uint32_t num_recvs_[2] = {0, 0};
+    uint32_t num_sends_[2] = {0, 0};
+};
+
+// memcpy transport: endpoints of num_domains domains of one process in a periodic ring, for rows
+// of up to capacity elements. Endpoint d is used by the thread of domain d.
+static inline std::vector<std::unique_ptr<halo_transport>> halo_memcpy_ring(const int num_domains,
+                                                                           const int capacity,
+                                                                           const halo_mode mode,
+                                                                           const int spins) {
+    const size_t mailbox_bytes = halo_mailbox_bytes(capacity);
+    std::shared_ptr<void> storage(aligned_alloc(64, 2 * num_domains * mailbox_bytes), free);
+    auto mailbox = [&](const int d, const int edge) {
+        return reinterpret_cast<halo_mailbox*>(static_cast<char*>(storage.get()) +
+                                               (2 * d + edge) * mailbox_bytes);
+    };
+    for (int d = 0; d < num_domains; ++d)
+        for (int edge = 0; edge < 2; ++edge)
+            halo_mailbox_init(mailbox(d, edge), false);
+    // One address space: the offsets of direct receives are the addresses themselves
+    char* const no_region[2] = {nullptr, nullptr};
+    std::vector<std::unique_ptr<halo_transport>> endpoints;
+    for (int d = 0; d < num_domains; ++d) {
+        const int top = d > 0 ? d - 1 : (num_domains - 1);
+        const int bottom = (d + 1) % num_domains;
+        halo_mailbox* const in[2] = {mailbox(d, HALO_TOP), mailbox(d, HALO_BOTTOM)};
+        halo_mailbox* const out[2] = {mailbox(top, HALO_BOTTOM), mailbox(bottom, HALO_TOP)};
+        endpoints.emplace_back(new mailbox_transport(HALO_MEMCPY, mode, in, out, nullptr,
+                                                     no_region, spins, storage));
+    }
+    return endpoints;
+}
+
+// Control area of a shm segment with the mailboxes of both edges
+static inline size_t halo_shm_control_bytes(const int capacity) {
+    return 2 * halo_mailbox_bytes(capacity);
+}
+
+// Sets up the mailboxes in the control area of the own segment, before the neighbours attach
+static inline void halo_shm_init(shm_domain* own, const int capacity) {
+    for (int edge = 0; edge < 2; ++edge)
+        halo_mailbox_init(own->control + edge * halo_mailbox_bytes(capacity), true);
+}
+
+// shm transport: endpoint of the process of own, whose neighbours' segments are mapped as top and
+// bottom. Direct receives have to go to the grids of the own segment.
+static inline std::unique_ptr<halo_transport> halo_shm_endpoint(const shm_domain& own,
+                                                                const shm_domain& top,
+                                                                const shm_domain& bottom,
+                                                                const int capacity,
+                                                                const halo_mode mode,
+                                                                const int spins) {
+    const size_t mailbox_bytes = halo_mailbox_bytes(capacity);
+    auto mailbox = [mailbox_bytes](const shm_domain& domain, const int edge) {
+        return reinterpret_cast<halo_mailbox*>(domain.control + edge * mailbox_bytes);
+    };
+    halo_mailbox* const in[2] = {mailbox(own, HALO_TOP), mailbox(own, HALO_BOTTOM)};
+    halo_mailbox* const out[2] = {mailbox(top, HALO_BOTTOM), mailbox(bottom, HALO_TOP)};
+    char* const peer_region[2] = {reinterpret_cast<char*>(top.grids[0]),
+                                  reinterpret_cast<char*>(bottom.grids[0])};
+    return std::unique_ptr<halo_transport>(
+        new mailbox_transport(HALO_SHM, mode, in, out, reinterpret_cast<char*>(own.grids[0]),
+                              peer_region, spins));
+}
+
+#ifdef MPI_VERSION
+// mpi transport: rows travel as bytes, tagged with the edge they arrive at. Packed rows are
+// copied into a send buffer when posted and out of a receive buffer when completed.
+class mpi_transport : public halo_transport {
+  public:
+    mpi_transport(MPI_Comm comm, const int top, const int bottom, const int capacity,
+                  const halo_mode mode)
+        : comm_(comm), mode_(mode) {
+        neighbour_[HALO_TOP] = top;
+        neighbour_[HALO_BOTTOM] = bottom;
+        if (HALO_PACKED == mode_)
+            for (int edge = 0; edge < 2; ++edge) {
+                send_buffer_[edge].resize(capacity);
+                recv_buffer_[edge].resize(capacity);
+            }
+        for (MPI_Request& request : requests_) request = MPI_REQUEST_NULL;
+    }
+
+    void post_recv(const halo_edge edge, real* const dst, const int count) override {
+        recv_dst_[edge] = dst;
+        recv_count_[edge] = count;
+        MPI_Irecv(HALO_PACKED == mode_ ? recv_buffer_[edge].data() : dst, count * sizeof(real),
+                  MPI_BYTE, neighbour_[edge], edge, comm_, &requests_[edge]);
+    }
+
+    void post_send(const halo_edge edge, const real* const src, const int count) override {
+        const real* buffer = src;
+        if (HALO_PACKED == mode_) {
+            std::memcpy(send_buffer_[edge].data(), src, count * sizeof(real));
+            buffer = send_buffer_[edge].data();
+        }
+        MPI_Isend(buffer, count * sizeof(real), MPI_BYTE, neighbour_[edge], halo_opposite(edge),
+                  comm_, &requests_[2 + edge]);
+    }
+
+    bool test() override {
+        int done = 0;
+        MPI_Testall(4, requests_, &done, MPI_STATUSES_IGNORE);
+        if (done) unpack();
+        return done;
+    }
+
+    void wait() override {
+        MPI_Waitall(4, requests_, MPI_STATUSES_IGNORE);
+        unpack();
+    }
+
+    halo_kind kind() const override { return HALO_MPI; }
+    halo_mode mode() const override { return mode_; }
+
+  private:
+    void unpack() {
+        if (HALO_PACKED != mode_) return;
+        for (int edge = 0; edge < 2; ++edge) {
+            if (recv_dst_[edge])
+                std::memcpy(recv_dst_[edge], recv_buffer_[edge].data(),
+                            recv_count_[edge] * sizeof(real));
+            recv_dst_[edge] = nullptr;
+        }
+    }
+
+    MPI_Comm comm_;
+    const halo_mode mode_;
+    int neighbour_[2];
+    MPI_Request requests_[4];  // Receives at the top and bottom edge, then the sends
+    real* recv_dst_[2] = {nullptr, nullptr};
+    int recv_count_[2] = {0, 0};
+    std::vector<real> send_buffer_[2];
+    std::vector<real> recv_buffer_[2];
+};
+#endif
+
+#endif  // JACOBI_TRANSPORT_H
@@ -0,0 +1,153 @@
+// Autotuning of the host stencil block shape and threads per domain.
+//
+// tune_search() times every candidate configuration with a trial function supplied by the driver,
+// re-times the fastest few to filter out noise and returns the winner. Winners are cached in a
+// plain text tuning database (one tab separated line per key) keyed by CPU model, problem size,
+// domain count and number of hardware threads; later runs find them with tune_lookup().
+#ifndef JACOBI_TUNE_H
+#define JACOBI_TUNE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+constexpr int TUNE_NUM_FINALISTS = 3;
+
+struct tune_key {
+    std::string cpu_model;
+    int nx;
+    int ny;
+    int num_domains;
+    int num_procs;
+};
+
+struct tune_config {
+    int block_x;
+    int block_y;
+    int num_threads;
+    double seconds;  // best trial time
+};
+
+static std::string tune_cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                const size_t begin = line.find_first_not_of(" \t", colon + 1);
+                return begin == std::string::npos ? "unknown" : line.substr(begin);
+            }
+        }
+    }
+    return "unknown";
+}
+
+static std::string tune_key_string(const tune_key& key) {
+    std::ostringstream out;
+    out << key.cpu_model << '\t' << key.nx << '\t' << key.ny << '\t' << key.num_domains << '\t'
+        << key.num_procs;
+    return out.str();
+}
+
+// Splits a database line into its key part and its configuration part.
+static bool tune_parse_line(const std::string& line, std::string* key, tune_config* config) {
+    if (line.empty() || '#' == line[0]) return false;
+    size_t pos = 0;
+    for (int field = 0; field < 5; ++field) {
+        pos = line.find('\t', pos);
+        if (std::string::npos == pos) return false;
+        ++pos;
+    }
+    *key = line.substr(0, pos - 1);
+    std::istringstream values(line.substr(pos));
+    return static_cast<bool>(values >> config->block_x >> config->block_y >> config->num_threads >>
+                             config->seconds);
+}
+
+static bool tune_lookup(const std::string& db, const tune_key& key, tune_config* config) {
+    std::ifstream in(db);
+    const std::string wanted = tune_key_string(key);
+    std::string line, line_key;
+    tune_config line_config;
+    bool found = false;
+    while (std::getline(in, line)) {
+        if (tune_parse_line(line, &line_key, &line_config) && line_key == wanted) {
+            *config = line_config;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Replaces the entry for key, keeping all other entries.
+static bool tune_store(const std::string& db, const tune_key& key, const tune_config& config) {
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(db);
+        std::string line, line_key;
+        tune_config line_config;
+        while (std::getline(in, line)) {
+            if (!tune_parse_line(line, &line_key, &line_config)) continue;
+            if (line_key != tune_key_string(key)) lines.push_back(line);
+        }
+    }
+    std::ofstream out(db, std::ios::trunc);
+    if (!out) {
+        fprintf(stderr, "WARNING: could not write tuning database %s\n", db.c_str());
+        return false;
+    }
+    out << "# cpu_model\tnx\tny\tndomains\tnprocs\tblockx blocky nthreads seconds\n";
+    for (const std::string& line : lines) out << line << '\n';
+    out << tune_key_string(key) << '\t' << config.block_x << ' ' << config.block_y << ' '
+        << config.num_threads << ' ' << config.seconds << '\n';
+    return static_cast<bool>(out);
+}
+
+// Block shapes and threads per domain to try. 0 is the kernel default (full rows, one block of
+// rows per thread). fixed_threads > 0 pins the threads per domain.
+static std::vector<tune_config> tune_candidates(const int nx, const int min_chunk_size,
+                                                const int num_domains, const int num_procs,
+                                                const int fixed_threads) {
+    std::vector<int> threads;
+    if (fixed_threads > 0) {
+        threads.push_back(fixed_threads);
+    } else {
+        for (int t = 1; t == 1 || t * num_domains <= num_procs; t *= 2) threads.push_back(t);
+    }
+    std::vector<tune_config> candidates;
+    for (int num_threads : threads) {
+        for (int block_x : {0, 128, 512, 2048}) {
+            if (block_x >= nx - 2) continue;
+            for (int block_y : {0, 1, 8, 32, 128}) {
+                if (block_y > min_chunk_size) continue;
+                candidates.push_back({block_x, block_y, num_threads, 0.0});
+            }
+        }
+    }
+    return candidates;
+}
+
+// trial(config) runs the stencil with the given configuration and returns its runtime in seconds.
+template <typename Trial>
+static tune_config tune_search(std::vector<tune_config> candidates, Trial trial, const bool print) {
+    for (tune_config& config : candidates) config.seconds = trial(config);
+    std::sort(candidates.begin(), candidates.end(),
+              [](const tune_config& l, const tune_config& r) { return l.seconds < r.seconds; });
+    const int num_finalists = std::min<int>(TUNE_NUM_FINALISTS, candidates.size());
+    for (int i = 0; i < num_finalists; ++i)
+        candidates[i].seconds = std::min(candidates[i].seconds, trial(candidates[i]));
+    std::sort(candidates.begin(), candidates.begin() + num_finalists,
+              [](const tune_config& l, const tune_config& r) { return l.seconds < r.seconds; });
+    if (print) {
+        for (int i = 0; i < num_finalists; ++i)
+            printf("  block %4d x %4d, %2d threads per domain: %8.4f s\n", candidates[i].block_x,
+                   candidates[i].block_y, candidates[i].num_threads, candidates[i].seconds);
+    }
+    return candidates[0];
+}
+
+#endif  // JACOBI_TUNE_H